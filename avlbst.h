@@ -6,14 +6,18 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <iterator>
+#include <vector>
 #include "bst.h"
+#include "parallel.h"
 
 struct KeyError { };
 
 /**
-* A special kind of node for an AVL tree, which adds the balance as a data member, plus
-* other additional helper functions. You do NOT need to implement any functionality or
-* add additional data members or helper functions.
+* A special kind of node for an AVL tree, which adds the balance plus other additional
+* helper functions. The balance (-1, 0 or 1) is kept as a 2-bit two's complement value
+* in the tag bits of the parent link, so an AVLNode is exactly as large as a Node and
+* has no padding.
 */
 template <typename Key, typename Value>
 class AVLNode : public Node<Key, Value>
@@ -21,22 +25,22 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    template<typename... Args>
+    AVLNode(AVLNode<Key, Value>* parent, Args&&... itemArgs);
+    ~AVLNode();
 
-    // Getter/setter for the node's height.
+    // Getter/setter for the node's balance, height(left) - height(right).
+    // Only -1, 0 and 1 can be stored.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
     // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
-
-protected:
-    int8_t balance_;    // effectively a signed char
+    // return pointers to AVLNodes - not plain Nodes. They hide (not override) the
+    // Node versions; see the Node class in bst.h for more information.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 };
 
 /*
@@ -50,9 +54,21 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent)
 {
+    setBalance(0);
+
+}
 
+/**
+* A constructor that builds the item in place; see the matching Node constructor.
+*/
+template<class Key, class Value>
+template<typename... Args>
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value>* parent, Args&&... itemArgs) :
+    Node<Key, Value>(parent, std::forward<Args>(itemArgs)...)
+{
+    setBalance(0);
 }
 
 /**
@@ -70,7 +86,8 @@ AVLNode<Key, Value>::~AVLNode()
 template<class Key, class Value>
 int8_t AVLNode<Key, Value>::getBalance() const
 {
-    return balance_;
+    // sign-extend the 2-bit tag
+    return static_cast<int8_t>((this->getTag() ^ 2) - 2);
 }
 
 /**
@@ -79,7 +96,7 @@ int8_t AVLNode<Key, Value>::getBalance() const
 template<class Key, class Value>
 void AVLNode<Key, Value>::setBalance(int8_t balance)
 {
-    balance_ = balance;
+    this->setTag(static_cast<unsigned>(balance));
 }
 
 /**
@@ -88,17 +105,17 @@ void AVLNode<Key, Value>::setBalance(int8_t balance)
 template<class Key, class Value>
 void AVLNode<Key, Value>::updateBalance(int8_t diff)
 {
-    balance_ += diff;
+    setBalance(getBalance() + diff);
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
+* A redefined getter for the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 {
-    return static_cast<AVLNode<Key, Value>*>(this->parent_);
+    return static_cast<AVLNode<Key, Value>*>(Node<Key, Value>::getParent());
 }
 
 /**
@@ -126,73 +143,623 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
   -----------------------------------------------
 */
 
+/**
+* An AVLNode that also knows how many nodes are in its subtree (itself
+* included). Used by AVLTree's order-statistic mode.
+*/
+template <typename Key, typename Value>
+class SizedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    template<typename... Args>
+    SizedAVLNode(SizedAVLNode<Key, Value>* parent, Args&&... itemArgs);
+
+    std::size_t getSize() const;
+    void setSize(std::size_t size);
+
+protected:
+    std::size_t size_;
+};
+
+/**
+* A new node is a leaf, so its subtree is just itself.
+*/
+template<class Key, class Value>
+template<typename... Args>
+SizedAVLNode<Key, Value>::SizedAVLNode(SizedAVLNode<Key, Value>* parent, Args&&... itemArgs) :
+    AVLNode<Key, Value>(parent, std::forward<Args>(itemArgs)...),
+    size_(1)
+{
+}
+
+/**
+* A getter for the subtree size.
+*/
+template<class Key, class Value>
+std::size_t SizedAVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the subtree size.
+*/
+template<class Key, class Value>
+void SizedAVLNode<Key, Value>::setSize(std::size_t size)
+{
+    size_ = size;
+}
+
+/**
+* An AVL node (BaseNode is AVLNode or SizedAVLNode) that also links to its
+* in-order neighbours. Used by AVLTree's threaded mode.
+*/
+template <typename Key, typename Value, typename BaseNode>
+class ThreadedAVLNode : public BaseNode
+{
+public:
+    template<typename... Args>
+    ThreadedAVLNode(ThreadedAVLNode<Key, Value, BaseNode>* parent, Args&&... itemArgs);
+
+    ThreadLinks<Key, Value>& getLinks();
+
+protected:
+    ThreadLinks<Key, Value> links_;
+};
+
+/**
+* A new node is linked into the thread by the tree once it has a place.
+*/
+template<class Key, class Value, class BaseNode>
+template<typename... Args>
+ThreadedAVLNode<Key, Value, BaseNode>::ThreadedAVLNode(ThreadedAVLNode<Key, Value, BaseNode>* parent, Args&&... itemArgs) :
+    BaseNode(parent, std::forward<Args>(itemArgs)...)
+{
+    links_.next = nullptr;
+    links_.prev = nullptr;
+}
+
+/**
+* A getter for the neighbour links.
+*/
+template<class Key, class Value, class BaseNode>
+ThreadLinks<Key, Value>& ThreadedAVLNode<Key, Value, BaseNode>::getLinks()
+{
+    return links_;
+}
+
+/**
+* Optional features of an AVLTree, given as its fourth template argument.
+* All are off by default, and a feature that is off adds no field to the
+* nodes and no work to any update.
+*
+* OrderStatistics keeps subtree sizes in the nodes (one extra word each)
+* for rank(), select(), count_range() and an O(1) size().
+*
+* Threaded keeps in-order next/prev links in the nodes (two extra words
+* each), so every iterator step is a single load instead of a walk
+* through parent links. Inserts and removes pay a few extra stores.
+*/
+template<bool OrderStatistics = false, bool Threaded = false>
+struct AVLOptions
+{
+    static const bool orderStatistics = OrderStatistics;
+    static const bool threaded = Threaded;
+};
+
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key>, class Options = AVLOptions<> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    template<typename ForwardIt>
+    AVLTree(ForwardIt first, ForwardIt last, const Compare& comp = Compare());
+    // Copies keep every node's balance (and size) as it is: O(n), with no
+    // comparisons and no rotations. Moves are O(1).
+    AVLTree(const AVLTree& other);
+    AVLTree(AVLTree&& other) noexcept;
+    AVLTree& operator=(const AVLTree& other);
+    AVLTree& operator=(AVLTree&& other) noexcept;
+    virtual ~AVLTree();
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    virtual void insert (std::pair<const Key, Value>&& new_item);
+    // Hinted inserts; see BinarySearchTree. Rebalancing after an append
+    // is O(1) amortized, so so is each insert of a key-ordered stream.
+    iterator insert(iterator hint, const std::pair<const Key, Value>& new_item);
+    iterator insert(iterator hint, std::pair<const Key, Value>&& new_item);
     virtual void remove(const Key& key);  // TODO
+    // erase(pos) as in BinarySearchTree. erase(first, last) splits the
+    // range out and joins the two sides around last, so it rebalances
+    // once in O(log n) instead of once per item, plus O(k) to free them;
+    // short ranges, where that does not pay, go item by item.
+    using BinarySearchTree<Key, Value, Compare>::erase;
+    iterator erase(iterator first, iterator last);
+
+    template<typename... Args>
+    std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+    // Bulk loads. Both replace the contents of the tree; of several items
+    // with the same key the last one wins, as with repeated inserts.
+    template<typename ForwardIt>
+    void assign_sorted(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last, unsigned threads = 0);
+
+    // Join-based bulk operations. Each takes over other's nodes (and its
+    // memory) and leaves it empty; where both trees hold a key, this
+    // tree's item is kept. join() appends a tree whose keys all follow
+    // this tree's (std::invalid_argument otherwise) in O(log n). unite,
+    // intersect and subtract leave this tree holding the union,
+    // intersection or difference (this minus other) in O(m log(n/m + 1))
+    // for sizes m <= n, working on both halves in parallel on up to
+    // `threads` threads (0 means one per core). Compare must not throw.
+    // A threaded tree (AVLOptions<..., true>) is re-threaded by one
+    // in-order walk after unite, intersect and subtract, which adds O(n)
+    // to each of them; join() stays O(log n).
+    void join(AVLTree& right);
+    void unite(AVLTree& other, unsigned threads = 0);
+    void intersect(AVLTree& other, unsigned threads = 0);
+    void subtract(AVLTree& other, unsigned threads = 0);
+
+    // Batch updates for large batches in any order. insert_batch takes
+    // key/value pairs and, like insert(), overwrites existing values (of
+    // equal keys within the batch the last one wins); erase_batch takes
+    // keys. The batch is sorted (on up to `threads` threads) and merged
+    // in with the same join-based recursion as unite/subtract, so a batch
+    // of k keys costs O(k log(n/k + 1)) instead of k separate descents.
+    // In a threaded tree both also pay the O(n) re-threading walk.
+    template<typename ForwardIt>
+    void insert_batch(ForwardIt first, ForwardIt last, unsigned threads = 0);
+    template<typename ForwardIt>
+    void erase_batch(ForwardIt first, ForwardIt last, unsigned threads = 0);
+
+    // Order statistics, O(log n) each; only with AVLOptions<true>.
+    // rank(key) is the number of keys before key, select(i) the item
+    // with rank i (end() if i >= size()), count_range(lo, hi) the number
+    // of keys with lo <= key < hi.
+    std::size_t size() const;
+    std::size_t rank(const Key& key) const;
+    iterator select(std::size_t i) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
 protected:
+    // the node type actually allocated: AVLNode, or SizedAVLNode when
+    // subtree sizes are kept, wrapped in a ThreadedAVLNode when threaded
+    typedef typename std::conditional<Options::orderStatistics,
+        SizedAVLNode<Key, Value>, AVLNode<Key, Value> >::type UnthreadedNode;
+    typedef typename std::conditional<Options::threaded,
+        ThreadedAVLNode<Key, Value, UnthreadedNode>, UnthreadedNode>::type TreeNode;
+    typedef std::integral_constant<bool, Options::orderStatistics> KeepSizes;
+    typedef std::integral_constant<bool, Options::threaded> KeepThreads;
+
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void removeNode(Node<Key, Value>* n);
 
     // Add helper functions here ROTATES and InsertFix and RemoveFix
     void rotateLeft(AVLNode<Key, Value>* x);
     void rotateRight(AVLNode<Key, Value>* x);
+    static AVLNode<Key, Value>* rotateLeftAt(AVLNode<Key, Value>* x);
+    static AVLNode<Key, Value>* rotateRightAt(AVLNode<Key, Value>* x);
+    void insertRebalance(Node<Key, Value>* n);
     void insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n);
     void removeFix(AVLNode<Key, Value>* n, int8_t diff);
-
+    template<typename ForwardIt>
+    bool countSorted(ForwardIt first, ForwardIt last, std::size_t& count);
+    template<typename ForwardIt>
+    AVLNode<Key, Value>* buildSorted(ForwardIt& it, ForwardIt last, std::size_t count);
+    static int8_t sortedHeight(std::size_t count);
+
+    // Subtree size upkeep; the std::false_type overloads do nothing.
+    static std::size_t subtreeSize(Node<Key, Value>* n);
+    static void updateSize(AVLNode<Key, Value>* n, std::true_type);
+    static void updateSize(AVLNode<Key, Value>*, std::false_type) {}
+    static void addToPathSizes(AVLNode<Key, Value>* n, std::size_t delta, std::true_type);
+    static void addToPathSizes(AVLNode<Key, Value>*, std::size_t, std::false_type) {}
+    static void swapSizes(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2, std::true_type);
+    static void swapSizes(AVLNode<Key, Value>*, AVLNode<Key, Value>*, std::false_type) {}
+
+    // Join-based primitives. They work on detached subtrees (root parent
+    // null) and never touch root_, so the set operations can run them on
+    // several threads at once. Heights are not stored, only balances, so
+    // a subtree travels with its height.
+    struct Subtree
+    {
+        AVLNode<Key, Value>* root;
+        int height;
+    };
+    // Nodes the set operations drop, as whole subtrees chained through
+    // their roots' parent links; destroyed once the parallel part is over.
+    struct DropList
+    {
+        Node<Key, Value>* head;
+        Node<Key, Value>* tail;
+    };
+    static const int PARALLEL_MIN_HEIGHT = 12;
+    // erase(first, last) removes shorter ranges one node at a time
+    static const int ERASE_SPLIT_MIN = 256;
+
+    Subtree wholeTree() const;
+    static int heightOf(AVLNode<Key, Value>* n);
+    static void splitRoot(Subtree t, Subtree& left, Subtree& right);
+    static Subtree joinTree(Subtree left, AVLNode<Key, Value>* mid, Subtree right);
+    static Subtree joinRight(Subtree left, AVLNode<Key, Value>* mid, Subtree right);
+    static Subtree joinLeft(Subtree left, AVLNode<Key, Value>* mid, Subtree right);
+    static AVLNode<Key, Value>* growFix(AVLNode<Key, Value>* n, int8_t diff, bool& grew);
+    static Subtree join2(Subtree left, Subtree right);
+    static AVLNode<Key, Value>* splitLast(Subtree t, Subtree& rest);
+    AVLNode<Key, Value>* splitTree(Subtree t, const Key& key, Subtree& left, Subtree& right) const;
+    template<bool Replace>
+    void uniteWith(AVLTree& other, unsigned threads);
+    template<bool Replace>
+    Subtree unionOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const;
+    static void takeValue(AVLNode<Key, Value>* to, AVLNode<Key, Value>* from, std::true_type);
+    static void takeValue(AVLNode<Key, Value>*, AVLNode<Key, Value>*, std::false_type) {}
+    Subtree eraseSorted(Subtree t, const Key* first, const Key* last, unsigned threads, DropList& drop) const;
+    Subtree intersectionOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const;
+    Subtree differenceOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const;
+    static void dropSubtree(DropList& drop, Node<Key, Value>* n);
+    static void appendDrops(DropList& drop, DropList& more);
+    void destroyDropped(DropList& drop);
+    static void updatePathSizes(AVLNode<Key, Value>* n, std::true_type);
+    static void updatePathSizes(AVLNode<Key, Value>*, std::false_type) {}
+
+    // Thread upkeep; again the std::false_type overloads do nothing.
+    static std::size_t linksOffset(std::true_type);
+    static std::size_t linksOffset(std::false_type) { return 0; }
+    static ThreadLinks<Key, Value>& links(Node<Key, Value>* n);
+    static void threadIn(AVLNode<Key, Value>* n, std::true_type);
+    static void threadIn(AVLNode<Key, Value>*, std::false_type) {}
+    static void threadOut(AVLNode<Key, Value>* n, std::true_type);
+    static void threadOut(AVLNode<Key, Value>*, std::false_type) {}
+    static void threadSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2, std::true_type);
+    static void threadSwap(AVLNode<Key, Value>*, AVLNode<Key, Value>*, std::false_type) {}
+    static void threadPair(Node<Key, Value>* prev, Node<Key, Value>* next);
+    static void threadPair(Node<Key, Value>* prev, Node<Key, Value>* next, std::true_type);
+    static void threadPair(Node<Key, Value>*, Node<Key, Value>*, std::false_type) {}
+    void threadAll(std::true_type);
+    void threadAll(std::false_type) {}
 };
 
+/**
+* Default constructor; sizes the node pool for AVLNodes.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreeNode), alignof(TreeNode))
+{
+    this->threadOffset_ = linksOffset(KeepThreads());
+}
+
+/**
+* Constructor for a tree ordered by the given comparator object.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreeNode), alignof(TreeNode), comp)
+{
+    this->threadOffset_ = linksOffset(KeepThreads());
+}
+
+/**
+* Builds a tree from a range of key/value pairs in any order. Sorted
+* input is loaded in linear time; see assign().
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename ForwardIt>
+AVLTree<Key, Value, Compare, Options>::AVLTree(ForwardIt first, ForwardIt last, const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreeNode), alignof(TreeNode), comp)
+{
+    this->threadOffset_ = linksOffset(KeepThreads());
+    assign(first, last);
+}
+
+/**
+* Copy constructor; clones other's nodes as TreeNodes, see
+* BinarySearchTree::cloneTree. A threaded copy is threaded afresh.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>::AVLTree(const AVLTree& other) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(TreeNode), alignof(TreeNode), other.comp_)
+{
+    this->threadOffset_ = linksOffset(KeepThreads());
+    this->root_ = this->template cloneTree<TreeNode>(other.root_);
+    threadAll(KeepThreads());
+}
+
+/**
+* Move constructor: takes over other's nodes and leaves it empty.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>::AVLTree(AVLTree&& other) noexcept :
+    BinarySearchTree<Key, Value, Compare>(std::move(other))
+{
+}
+
+/**
+* Copy assignment; leaves this tree as it was if the copy throws.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>&
+AVLTree<Key, Value, Compare, Options>::operator=(const AVLTree& other)
+{
+    if (this != &other) {
+        AVLTree<Key, Value, Compare, Options> copy(other);
+        this->swap(copy);
+    }
+    return *this;
+}
+
+/**
+* Move assignment: drops this tree's nodes and takes over other's.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>&
+AVLTree<Key, Value, Compare, Options>::operator=(AVLTree&& other) noexcept
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Destructor. The nodes are cleared here rather than in ~BinarySearchTree
+* so that destroyNode still runs the AVLNode destructor.
+*/
+template<class Key, class Value, class Compare, class Options>
+AVLTree<Key, Value, Compare, Options>::~AVLTree()
+{
+    this->clear();
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::insert (const std::pair<const Key, Value> &new_item)
+{
+    // overwrites the value if the key exists
+    std::pair<Node<Key, Value>*, bool> result = this->template insertOrAssign<TreeNode>(
+        new_item, typename BinarySearchTree<Key, Value, Compare>::CopyableItem());
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+}
+
+/**
+* Move-aware insert; see BinarySearchTree::insert.
+*/
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::insert (std::pair<const Key, Value>&& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertOrAssign<TreeNode>(
+        std::move(new_item), typename BinarySearchTree<Key, Value, Compare>::MovableItem());
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+}
+
+/**
+* Inserts from hint; see BinarySearchTree::insert(iterator, ...).
+*/
+template<class Key, class Value, class Compare, class Options>
+typename AVLTree<Key, Value, Compare, Options>::iterator
+AVLTree<Key, Value, Compare, Options>::insert (iterator hint, const std::pair<const Key, Value>& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template insertOrAssignNear<TreeNode>(hint, new_item);
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+    return this->makeIterator(result.first);
+}
+
+template<class Key, class Value, class Compare, class Options>
+typename AVLTree<Key, Value, Compare, Options>::iterator
+AVLTree<Key, Value, Compare, Options>::insert (iterator hint, std::pair<const Key, Value>&& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template insertOrAssignNear<TreeNode>(hint, std::move(new_item));
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+    return this->makeIterator(result.first);
+}
+
+/**
+* Builds the item in place; see BinarySearchTree::emplace.
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+AVLTree<Key, Value, Compare, Options>::emplace(Args&&... args)
 {
-    // get key and value
-    const Key& key = new_item.first;
-    const Value& value = new_item.second;
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template emplaceUnique<TreeNode>(std::forward<Args>(args)...);
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+/**
+* Inserts only if key is missing; see BinarySearchTree::try_emplace.
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+AVLTree<Key, Value, Compare, Options>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<TreeNode>(key,
+        std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+AVLTree<Key, Value, Compare, Options>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<TreeNode>(key,
+        std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    if (result.second) {
+        insertRebalance(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+/**
+* Replaces the contents with the items in [first, last), which must be
+* sorted by key (equal keys allowed). Runs in O(n): the tree is built
+* bottom-up with every balance already correct and no rotations.
+* Throws std::invalid_argument, leaving the tree untouched, if the range
+* is not sorted.
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, Options>::assign_sorted(ForwardIt first, ForwardIt last)
+{
+    std::size_t count;
+    if (!countSorted(first, last, count)) {
+        throw std::invalid_argument("assign_sorted: range is not sorted by key");
+    }
+    this->clear();
+    this->root_ = buildSorted(first, last, count);
+    threadAll(KeepThreads());
+}
 
-    // tree empty!
-    if (this->root_ == nullptr) {
-        this->root_ = new AVLNode<Key, Value>(key, value, nullptr);
+/**
+* Replaces the contents with the items in [first, last) in any order.
+* Sorted input goes straight to the linear build; otherwise the items are
+* copied and stable-sorted on up to `threads` threads first (0 means one
+* per core).
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, Options>::assign(ForwardIt first, ForwardIt last, unsigned threads)
+{
+    std::size_t count;
+    if (countSorted(first, last, count)) {
+        this->clear();
+        this->root_ = buildSorted(first, last, count);
+        threadAll(KeepThreads());
         return;
     }
 
-    // traverse tree like BST
-    // static cast to convert base pointer to derived type since getleft, getright, etc alll return Node<Key,Value>*
-    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
-    AVLNode<Key, Value>* parent = nullptr;
+    // std::pair<const Key, Value> cannot be sorted in place, so sort a copy
+    typedef std::pair<Key, Value> Item;
+    std::vector<Item> items(first, last);
+    Compare comp = this->comp_;
+    parallelStableSort(items.begin(), items.end(),
+        [comp](const Item& a, const Item& b) { return comp(a.first, b.first); }, threads);
+    assign_sorted(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+}
 
-    while (curr != nullptr) {
-        parent = curr;
+/**
+* Counts the distinct keys in a range. Returns false if the range is
+* not sorted by key.
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename ForwardIt>
+bool AVLTree<Key, Value, Compare, Options>::countSorted(ForwardIt first, ForwardIt last, std::size_t& count)
+{
+    count = 0;
+    if (first == last) return true;
+    count = 1;
+    ForwardIt prev = first;
+    for (ForwardIt it = ++first; it != last; prev = it, ++it) {
+        int cmp = compareKeys(this->comp_, it->first, prev->first);
+        if (cmp < 0) return false;
+        if (cmp > 0) count++;
+    }
+    return true;
+}
 
-        if (key < curr->getKey()) {
-            curr = curr->getLeft();
-        }
-        else if (key > curr->getKey()) {
-            curr = curr->getRight();
-        }
-        else {
-            // key exists, overwrite value
-            curr->setValue(value);
-            return;
+/**
+* Height of the subtree buildSorted makes from count items: the number of
+* bits in count, i.e. ceil(log2(count + 1)).
+*/
+template<class Key, class Value, class Compare, class Options>
+int8_t AVLTree<Key, Value, Compare, Options>::sortedHeight(std::size_t count)
+{
+    int8_t height = 0;
+    while (count != 0) {
+        height++;
+        count >>= 1;
+    }
+    return height;
+}
+
+/**
+* Builds a balanced subtree from the next count distinct keys starting at
+* it, consuming them in order so the nodes are also allocated in key
+* order. The right half gets the extra item when count - 1 is odd, so
+* every balance is 0 or -1. Recursion depth is O(log n).
+*/
+template<class Key, class Value, class Compare, class Options>
+template<typename ForwardIt>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::buildSorted(ForwardIt& it, ForwardIt last, std::size_t count)
+{
+    if (count == 0) return nullptr;
+    std::size_t leftCount = (count - 1) / 2;
+    std::size_t rightCount = count - 1 - leftCount;
+
+    AVLNode<Key, Value>* left = buildSorted(it, last, leftCount);
+    AVLNode<Key, Value>* node;
+    try {
+        // of a run of equal keys only the last one is kept
+        ForwardIt item = it;
+        for (++it; it != last && !this->comp_(item->first, it->first); ++it) {
+            item = it;
         }
+        node = this->createNode(static_cast<TreeNode*>(nullptr), *item);
+    }
+    catch (...) {
+        this->deleteTree(left);
+        throw;
     }
 
-    // create new node n attach
-    AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(key, value, parent);
-    // key is less = LEFTT
-    if (key < parent->getKey()) {
-        parent->setLeft(newNode);
+    AVLNode<Key, Value>* right;
+    try {
+        right = buildSorted(it, last, rightCount);
     }
-    // key is more = RIGHT
-    else {
-        parent->setRight(newNode);
+    catch (...) {
+        this->deleteTree(left);
+        this->destroyNode(node);
+        throw;
     }
 
+    node->setLeft(left);
+    if (left != nullptr) left->setParent(node);
+    node->setRight(right);
+    if (right != nullptr) right->setParent(node);
+    node->setBalance(sortedHeight(leftCount) - sortedHeight(rightCount));
+    updateSize(node, KeepSizes());
+    return node;
+}
+
+/**
+* Restores the AVL property after n has been linked in as a new leaf.
+*/
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::insertRebalance(Node<Key, Value>* n)
+{
+    AVLNode<Key, Value>* newNode = static_cast<AVLNode<Key, Value>*>(n);
+    threadIn(newNode, KeepThreads());
+    AVLNode<Key, Value>* parent = newNode->getParent();
+    if (parent == nullptr) return;
+    addToPathSizes(parent, 1, KeepSizes());
+
     // update balance and check conditions
     if (parent->getBalance() == 1 || parent->getBalance() == -1) {
         parent->setBalance(0); // height unchanged, done
@@ -206,75 +773,91 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
         parent->setBalance(-1);
     }
 
-    // recurse upward to fix
+    // walk upward to fix
     insertFix(parent, newNode);
 }
 
 // insert fix! (using class slides for AVL implementation)
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n)
-{
-    if (p == nullptr) return;
-    AVLNode<Key, Value>* g = p->getParent();
-    if (g == nullptr) return;
-
-    // determine side of p relative to g
-    if (p == g->getLeft()) {
-        g->updateBalance(1); // inserted into left subtree
-
-        if (g->getBalance() == 0) return;
-        else if (g->getBalance() == 1) {
-            insertFix(g, p); // keep propagating up
-        } else if (g->getBalance() == 2) {
-            // rebalancing needed
-            if (n == p->getLeft()) {
-                // zig-zig (left-left)
-                rotateRight(g);
-                p->setBalance(0);
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n)
+{
+    // each pass moves one level up while the subtree height keeps growing
+    while (p != nullptr) {
+        AVLNode<Key, Value>* g = p->getParent();
+        if (g == nullptr) return;
+
+        // determine side of p relative to g; the new balance is worked out
+        // locally because +-2 cannot be stored in a node
+        if (p == g->getLeft()) {
+            int8_t balance = g->getBalance() + 1; // inserted into left subtree
+
+            if (balance == 0) {
                 g->setBalance(0);
-            } else {
-                // zig-zag (left-right)
-                rotateLeft(p);
-                rotateRight(g);
-                if (n->getBalance() == 1) {
-                    p->setBalance(0); g->setBalance(-1);
-                } else if (n->getBalance() == 0) {
-                    p->setBalance(0); g->setBalance(0);
+                return;
+            }
+            else if (balance == 1) {
+                g->setBalance(1);
+                n = p; // keep propagating up
+                p = g;
+                continue;
+            } else if (balance == 2) {
+                // rebalancing needed
+                if (n == p->getLeft()) {
+                    // zig-zig (left-left)
+                    rotateRight(g);
+                    p->setBalance(0);
+                    g->setBalance(0);
                 } else {
-                    p->setBalance(1); g->setBalance(0);
+                    // zig-zag (left-right)
+                    rotateLeft(p);
+                    rotateRight(g);
+                    if (n->getBalance() == 1) {
+                        p->setBalance(0); g->setBalance(-1);
+                    } else if (n->getBalance() == 0) {
+                        p->setBalance(0); g->setBalance(0);
+                    } else {
+                        p->setBalance(1); g->setBalance(0);
+                    }
+                    n->setBalance(0);
                 }
-                n->setBalance(0);
             }
         }
-    }
-    else {
-        // symmetric case: p is right child
-        g->updateBalance(-1); // inserted into right subtree
-
-        if (g->getBalance() == 0) return;
-        else if (g->getBalance() == -1) {
-            insertFix(g, p); // keep propagating up
-        } else if (g->getBalance() == -2) {
-            // rebalancing needed
-            if (n == p->getRight()) {
-                // zig-zig (right-right)
-                rotateLeft(g);
-                p->setBalance(0);
+        else {
+            // symmetric case: p is right child
+            int8_t balance = g->getBalance() - 1; // inserted into right subtree
+
+            if (balance == 0) {
                 g->setBalance(0);
-            } else {
-                // zig-zag (right-left)
-                rotateRight(p);
-                rotateLeft(g);
-                if (n->getBalance() == -1) {
-                    p->setBalance(0); g->setBalance(1);
-                } else if (n->getBalance() == 0) {
-                    p->setBalance(0); g->setBalance(0);
+                return;
+            }
+            else if (balance == -1) {
+                g->setBalance(-1);
+                n = p; // keep propagating up
+                p = g;
+                continue;
+            } else if (balance == -2) {
+                // rebalancing needed
+                if (n == p->getRight()) {
+                    // zig-zig (right-right)
+                    rotateLeft(g);
+                    p->setBalance(0);
+                    g->setBalance(0);
                 } else {
-                    p->setBalance(-1); g->setBalance(0);
+                    // zig-zag (right-left)
+                    rotateRight(p);
+                    rotateLeft(g);
+                    if (n->getBalance() == -1) {
+                        p->setBalance(0); g->setBalance(1);
+                    } else if (n->getBalance() == 0) {
+                        p->setBalance(0); g->setBalance(0);
+                    } else {
+                        p->setBalance(-1); g->setBalance(0);
+                    }
+                    n->setBalance(0);
                 }
-                n->setBalance(0);
             }
         }
+        return;
     }
 }
 
@@ -282,189 +865,298 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>*
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::remove(const Key& key)
 {
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
+    Node<Key, Value>* node = this->internalFind(key);
     if (node == nullptr) return;
+    removeNode(node);
+}
 
-    // step 1: if node has two children, swap with predecessor
-    if (node->getLeft() && node->getRight()) {
-        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
-        this->nodeSwap(node, pred);
+/**
+* Removes the range with two splits and a join: the keys before first
+* (left), those in [first, last), and those from last on (right), with
+* last's own node cut out by the second split and reused as the join
+* key. Without a last node, left is the result. The splits cost about
+* as much as rebalancing after a couple of hundred single removes, so
+* a range shorter than ERASE_SPLIT_MIN goes through erase(pos) instead.
+*/
+template<class Key, class Value, class Compare, class Options>
+typename AVLTree<Key, Value, Compare, Options>::iterator
+AVLTree<Key, Value, Compare, Options>::erase(iterator first, iterator last)
+{
+    Node<Key, Value>* after = this->iteratorNode(last);
+    Node<Key, Value>* n = this->iteratorNode(first);
+    for (int i = 0; i < ERASE_SPLIT_MIN && n != after; i++) {
+        n = this->nextNode(n);
+    }
+    if (n == after) {
+        return BinarySearchTree<Key, Value, Compare>::erase(first, last);
+    }
+    Node<Key, Value>* before = this->prevNode(this->iteratorNode(first));
+
+    Subtree left, rest, doomed, right;
+    AVLNode<Key, Value>* firstNode = splitTree(wholeTree(), first->first, left, rest);
+    DropList drop = { nullptr, nullptr };
+    dropSubtree(drop, firstNode);
+    if (after == nullptr) {
+        dropSubtree(drop, rest.root);
+        this->root_ = left.root;
+        this->largest_ = before;
+    }
+    else {
+        AVLNode<Key, Value>* lastNode = splitTree(rest, after->getKey(), doomed, right);
+        dropSubtree(drop, doomed.root);
+        this->root_ = joinTree(left, lastNode, right).root;
     }
+    destroyDropped(drop);
+    threadPair(before, after, KeepThreads());
+    return last;
+}
+
+/**
+* Unlinks n, rebalancing on the way up, and destroys it.
+*/
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::removeNode(Node<Key, Value>* n)
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(n);
 
-    AVLNode<Key, Value>* parent = node->getParent();
-    AVLNode<Key, Value>* child = nullptr;
+    AVLNode<Key, Value>* parent;
     int8_t diff = 0;
 
-    if (node->getLeft() != nullptr) {
-        child = node->getLeft();
-    } else if (node->getRight() != nullptr) {
-        child = node->getRight();
+    // step 1: if node has two children, its predecessor takes its place,
+    // balance and size; the slot the predecessor leaves is the one lost
+    if (node->getLeft() && node->getRight()) {
+        AVLNode<Key, Value>* pred = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
+        pred->setBalance(node->getBalance());
+        swapSizes(node, pred, KeepSizes());
+        parent = static_cast<AVLNode<Key, Value>*>(this->splicePredecessor(node, pred));
+        diff = parent == pred ? +1 : -1;
     }
-
-    // link child to parent
-    if (parent != nullptr) {
-        if (parent->getLeft() == node) {
-            parent->setLeft(child);
-            diff = +1;
+    else {
+        parent = node->getParent();
+        AVLNode<Key, Value>* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+
+        // link child to parent
+        if (parent != nullptr) {
+            if (parent->getLeft() == node) {
+                parent->setLeft(child);
+                diff = +1;
+            } else {
+                parent->setRight(child);
+                diff = -1;
+            }
         } else {
-            parent->setRight(child);
-            diff = -1;
+            this->root_ = child;
         }
-    } else {
-        this->root_ = child;
-    }
 
-    if (child != nullptr) {
-        child->setParent(parent);
+        if (child != nullptr) {
+            child->setParent(parent);
+        }
     }
 
-    delete node;
+    if (node == this->largest_) {
+        this->largest_ = nullptr;
+    }
+    threadOut(node, KeepThreads());
+    this->destroyNode(node);
+    addToPathSizes(parent, std::size_t(-1), KeepSizes());
 
     // patch AVL balance
     removeFix(parent, diff);
 }
 
-// SEVENTH TIME REWRITING THIS PLS FKIN WORK PLEASEEE
+// balance is height(left) - height(right), the same convention insert uses;
+// diff is +1 when the left subtree of n lost height and -1 for the right
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int8_t diff)
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::removeFix(AVLNode<Key, Value>* n, int8_t diff)
 {
-    if (n == nullptr) return;
-
-    AVLNode<Key, Value>* p = n->getParent();
-    int8_t nextDiff = 0;
-    if (p != nullptr) {
-        nextDiff = (n == p->getLeft()) ? -1 : 1;
-    }
-
-    // left subtree lost a node
-    if (diff == +1)
-    {
-        if (n->getBalance() == -1)
-        {
-            n->setBalance(0);
-            removeFix(p, nextDiff);
-        }
-        else if (n->getBalance() == 0)
-        {
-            n->setBalance(1);
-            return;
+    // each pass moves one level up while the subtree height keeps shrinking
+    while (n != nullptr) {
+        AVLNode<Key, Value>* p = n->getParent();
+        int8_t nextDiff = 0;
+        if (p != nullptr) {
+            nextDiff = (n == p->getLeft()) ? 1 : -1;
         }
-        else if (n->getBalance() == 1)
-        {
-            AVLNode<Key, Value>* c = n->getRight();
-            if (c == nullptr) return;
 
-            if (c->getBalance() == 0)
+        // left subtree lost a node
+        if (diff == +1)
+        {
+            if (n->getBalance() == 1)
             {
-                // height unchanged after rotation
-                rotateLeft(n);
-                n->setBalance(1);
-                c->setBalance(-1);
-                return;
+                n->setBalance(0);
+                n = p;
+                diff = nextDiff;
+                continue;
             }
-            else if (c->getBalance() == 1)
+            else if (n->getBalance() == 0)
             {
-                // right-right case
-                rotateLeft(n);
-                n->setBalance(0);
-                c->setBalance(0);
-                removeFix(p, nextDiff);
+                n->setBalance(-1);
+                return;
             }
-            else if (c->getBalance() == -1)
+            else if (n->getBalance() == -1)
             {
-                // right-left case
-                AVLNode<Key, Value>* g = c->getLeft();
-                rotateRight(c);
-                rotateLeft(n);
-
-                int8_t b = g->getBalance();
-                if (b == 1) {
-                    n->setBalance(0); c->setBalance(-1);
-                } else if (b == 0) {
-                    n->setBalance(0); c->setBalance(0);
-                } else {
-                    n->setBalance(1); c->setBalance(0);
+                AVLNode<Key, Value>* c = n->getRight();
+                if (c == nullptr) return;
+
+                if (c->getBalance() == 0)
+                {
+                    // height unchanged after rotation
+                    rotateLeft(n);
+                    n->setBalance(-1);
+                    c->setBalance(1);
+                    return;
+                }
+                else if (c->getBalance() == -1)
+                {
+                    // right-right case
+                    rotateLeft(n);
+                    n->setBalance(0);
+                    c->setBalance(0);
+                    n = p;
+                    diff = nextDiff;
+                    continue;
+                }
+                else if (c->getBalance() == 1)
+                {
+                    // right-left case
+                    AVLNode<Key, Value>* g = c->getLeft();
+                    rotateRight(c);
+                    rotateLeft(n);
+
+                    int8_t b = g->getBalance();
+                    if (b == 1) {
+                        n->setBalance(0); c->setBalance(-1);
+                    } else if (b == 0) {
+                        n->setBalance(0); c->setBalance(0);
+                    } else {
+                        n->setBalance(1); c->setBalance(0);
+                    }
+                    g->setBalance(0);
+                    n = p;
+                    diff = nextDiff;
+                    continue;
                 }
-                g->setBalance(0);
-                removeFix(p, nextDiff);
             }
         }
-    }
 
-    // right subtree lost a node
-    else if (diff == -1)
-    {
-        if (n->getBalance() == 1)
+        // right subtree lost a node
+        else if (diff == -1)
         {
-            n->setBalance(0);
-            removeFix(p, nextDiff);
-        }
-        else if (n->getBalance() == 0)
-        {
-            n->setBalance(-1);
-            return;
-        }
-        else if (n->getBalance() == -1)
-        {
-            AVLNode<Key, Value>* c = n->getLeft();
-            if (c == nullptr) return;
-
-            if (c->getBalance() == 0)
+            if (n->getBalance() == -1)
             {
-                // height unchanged after rotation
-                rotateRight(n);
-                n->setBalance(-1);
-                c->setBalance(1);
-                return;
+                n->setBalance(0);
+                n = p;
+                diff = nextDiff;
+                continue;
             }
-            else if (c->getBalance() == -1)
+            else if (n->getBalance() == 0)
             {
-                // left-left case
-                rotateRight(n);
-                n->setBalance(0);
-                c->setBalance(0);
-                removeFix(p, nextDiff);
+                n->setBalance(1);
+                return;
             }
-            else if (c->getBalance() == 1)
+            else if (n->getBalance() == 1)
             {
-                // left-right case
-                AVLNode<Key, Value>* g = c->getRight();
-                rotateLeft(c);
-                rotateRight(n);
-
-                int8_t b = g->getBalance();
-                if (b == 1) {
-                    n->setBalance(-1); c->setBalance(0);
-                } else if (b == 0) {
-                    n->setBalance(0); c->setBalance(0);
-                } else {
-                    n->setBalance(0); c->setBalance(1);
+                AVLNode<Key, Value>* c = n->getLeft();
+                if (c == nullptr) return;
+
+                if (c->getBalance() == 0)
+                {
+                    // height unchanged after rotation
+                    rotateRight(n);
+                    n->setBalance(1);
+                    c->setBalance(-1);
+                    return;
+                }
+                else if (c->getBalance() == 1)
+                {
+                    // left-left case
+                    rotateRight(n);
+                    n->setBalance(0);
+                    c->setBalance(0);
+                    n = p;
+                    diff = nextDiff;
+                    continue;
+                }
+                else if (c->getBalance() == -1)
+                {
+                    // left-right case
+                    AVLNode<Key, Value>* g = c->getRight();
+                    rotateLeft(c);
+                    rotateRight(n);
+
+                    int8_t b = g->getBalance();
+                    if (b == 1) {
+                        n->setBalance(-1); c->setBalance(0);
+                    } else if (b == 0) {
+                        n->setBalance(0); c->setBalance(0);
+                    } else {
+                        n->setBalance(0); c->setBalance(1);
+                    }
+                    g->setBalance(0);
+                    n = p;
+                    diff = nextDiff;
+                    continue;
                 }
-                g->setBalance(0);
-                removeFix(p, nextDiff);
             }
         }
+        return;
     }
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    // sizes, like balances, belong to the position in the tree
+    swapSizes(n1, n2, KeepSizes());
+    // and so does the place in the thread
+    threadSwap(n1, n2, KeepThreads());
+}
+
+/**
+* Runs the node's own destructor before handing the slot back to the pool.
+*/
+template<class Key, class Value, class Compare, class Options>
+void AVLTree<Key, Value, Compare, Options>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<TreeNode*>(node)->~TreeNode();
+    this->pool_.deallocate(node);
 }
 
 // HELPERS!
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::rotateLeft(AVLNode<Key, Value>* x)
+{
+    AVLNode<Key, Value>* y = rotateLeftAt(x);
+    if (y->getParent() == nullptr) {
+        this->root_ = y;
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::rotateRight(AVLNode<Key, Value>* x)
+{
+    AVLNode<Key, Value>* y = rotateRightAt(x);
+    if (y->getParent() == nullptr) {
+        this->root_ = y;
+    }
+}
+
+/**
+* The rotation itself. Returns the subtree's new top node; if that has no
+* parent the caller decides where it goes, which lets the join-based
+* code rotate subtrees that are not part of the tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::rotateLeftAt(AVLNode<Key, Value>* x)
 {
     AVLNode<Key, Value>* y = x->getRight();
     x->setRight(y->getLeft());
@@ -473,20 +1165,23 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x)
     }
     y->setParent(x->getParent());
 
-    if (x->getParent() == nullptr) {
-        this->root_ = y;
-    } else if (x == x->getParent()->getLeft()) {
-        x->getParent()->setLeft(y);
-    } else {
-        x->getParent()->setRight(y);
+    if (x->getParent() != nullptr) {
+        if (x == x->getParent()->getLeft()) {
+            x->getParent()->setLeft(y);
+        } else {
+            x->getParent()->setRight(y);
+        }
     }
 
     y->setLeft(x);
     x->setParent(y);
+    updateSize(x, KeepSizes());
+    updateSize(y, KeepSizes());
+    return y;
 }
 
-template<typename Key, typename Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* x)
+template<typename Key, typename Value, typename Compare, typename Options>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::rotateRightAt(AVLNode<Key, Value>* x)
 {
     AVLNode<Key, Value>* y = x->getLeft();
     x->setLeft(y->getRight());
@@ -495,16 +1190,838 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* x)
     }
     y->setParent(x->getParent());
 
-    if (x->getParent() == nullptr) {
-        this->root_ = y;
-    } else if (x == x->getParent()->getLeft()) {
-        x->getParent()->setLeft(y);
-    } else {
-        x->getParent()->setRight(y);
+    if (x->getParent() != nullptr) {
+        if (x == x->getParent()->getLeft()) {
+            x->getParent()->setLeft(y);
+        } else {
+            x->getParent()->setRight(y);
+        }
     }
 
     y->setRight(x);
     x->setParent(y);
+    updateSize(x, KeepSizes());
+    updateSize(y, KeepSizes());
+    return y;
+}
+
+/**
+* Number of nodes under n, or 0 for an empty subtree. Only used when
+* subtree sizes are kept.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+std::size_t AVLTree<Key, Value, Compare, Options>::subtreeSize(Node<Key, Value>* n)
+{
+    return n == nullptr ? 0 : static_cast<TreeNode*>(n)->getSize();
+}
+
+/**
+* Recomputes n's size from its children, which must be up to date.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::updateSize(AVLNode<Key, Value>* n, std::true_type)
+{
+    static_cast<TreeNode*>(n)->setSize(1 + subtreeSize(n->getLeft()) + subtreeSize(n->getRight()));
+}
+
+/**
+* Adds delta (mod 2^N, so size_t(-1) subtracts one) to the size of n and
+* every ancestor of n.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::addToPathSizes(AVLNode<Key, Value>* n, std::size_t delta, std::true_type)
+{
+    for (; n != nullptr; n = n->getParent()) {
+        TreeNode* sized = static_cast<TreeNode*>(n);
+        sized->setSize(sized->getSize() + delta);
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::swapSizes(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2, std::true_type)
+{
+    TreeNode* s1 = static_cast<TreeNode*>(n1);
+    TreeNode* s2 = static_cast<TreeNode*>(n2);
+    std::size_t tempS = s1->getSize();
+    s1->setSize(s2->getSize());
+    s2->setSize(tempS);
+}
+
+/**
+* Appends right, whose keys must all follow this tree's, and leaves right
+* empty. O(log n) apart from taking over right's memory.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::join(AVLTree& right)
+{
+    if (&right == this || right.root_ == nullptr) return;
+    Node<Key, Value>* last = this->getLargestNode();
+    Node<Key, Value>* first = right.getSmallestNode();
+    if (last != nullptr && !this->comp_(last->getKey(), first->getKey())) {
+        throw std::invalid_argument("join: keys of right must all follow this tree's keys");
+    }
+
+    this->pool_.splice(right.pool_);
+    Subtree joined = join2(wholeTree(), right.wholeTree());
+    right.root_ = nullptr;
+    this->root_ = joined.root;
+    this->largest_ = right.largest_;
+    right.largest_ = nullptr;
+    threadPair(last, first, KeepThreads());
+}
+
+/**
+* Set union: adds other's items whose keys this tree lacks.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::unite(AVLTree& other, unsigned threads)
+{
+    uniteWith<false>(other, threads);
+}
+
+/**
+* Inserts a batch of key/value pairs; see the class declaration.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, Options>::insert_batch(ForwardIt first, ForwardIt last, unsigned threads)
+{
+    AVLTree<Key, Value, Compare, Options> batch(this->comp_);
+    batch.assign(first, last, threads);
+    uniteWith<true>(batch, threads);
+}
+
+/**
+* Removes a batch of keys; keys that are not in the tree are ignored.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Compare, Options>::erase_batch(ForwardIt first, ForwardIt last, unsigned threads)
+{
+    std::vector<Key> keys(first, last);
+    if (keys.empty()) return;
+    Compare comp = this->comp_;
+    parallelStableSort(keys.begin(), keys.end(), comp, threads);
+    keys.erase(std::unique(keys.begin(), keys.end(),
+        [comp](const Key& a, const Key& b) { return !comp(a, b); }), keys.end());
+
+    DropList drop = { nullptr, nullptr };
+    Subtree result = eraseSorted(wholeTree(), keys.data(), keys.data() + keys.size(),
+        threads == 0 ? defaultThreadCount() : threads, drop);
+    this->root_ = result.root;
+    this->largest_ = nullptr;
+    destroyDropped(drop);
+    threadAll(KeepThreads());
+}
+
+/**
+* unite(), and insert_batch() with Replace: other's value then overwrites
+* this tree's where both hold a key, though this tree's node stays.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+template<bool Replace>
+void AVLTree<Key, Value, Compare, Options>::uniteWith(AVLTree& other, unsigned threads)
+{
+    if (&other == this) return;
+    this->pool_.splice(other.pool_);
+    DropList drop = { nullptr, nullptr };
+    Subtree result = unionOf<Replace>(wholeTree(), other.wholeTree(), threads == 0 ? defaultThreadCount() : threads, drop);
+    other.root_ = nullptr;
+    other.largest_ = nullptr;
+    this->root_ = result.root;
+    this->largest_ = nullptr;
+    destroyDropped(drop);
+    threadAll(KeepThreads());
+}
+
+/**
+* Set intersection: keeps only the items whose keys other also holds.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::intersect(AVLTree& other, unsigned threads)
+{
+    if (&other == this) return;
+    this->pool_.splice(other.pool_);
+    DropList drop = { nullptr, nullptr };
+    Subtree result = intersectionOf(wholeTree(), other.wholeTree(), threads == 0 ? defaultThreadCount() : threads, drop);
+    other.root_ = nullptr;
+    other.largest_ = nullptr;
+    this->root_ = result.root;
+    this->largest_ = nullptr;
+    destroyDropped(drop);
+    threadAll(KeepThreads());
+}
+
+/**
+* Set difference: removes the items whose keys other holds.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::subtract(AVLTree& other, unsigned threads)
+{
+    if (&other == this) {
+        this->clear();
+        return;
+    }
+    this->pool_.splice(other.pool_);
+    DropList drop = { nullptr, nullptr };
+    Subtree result = differenceOf(wholeTree(), other.wholeTree(), threads == 0 ? defaultThreadCount() : threads, drop);
+    other.root_ = nullptr;
+    other.largest_ = nullptr;
+    this->root_ = result.root;
+    this->largest_ = nullptr;
+    destroyDropped(drop);
+    threadAll(KeepThreads());
+}
+
+/**
+* The whole tree as a Subtree.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::wholeTree() const
+{
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+    Subtree t = { root, heightOf(root) };
+    return t;
+}
+
+/**
+* Height of the subtree under n in O(log n): always step to the taller
+* child.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+int AVLTree<Key, Value, Compare, Options>::heightOf(AVLNode<Key, Value>* n)
+{
+    int height = 0;
+    while (n != nullptr) {
+        height++;
+        n = n->getBalance() < 0 ? n->getRight() : n->getLeft();
+    }
+    return height;
+}
+
+/**
+* Cuts the root of t off its two subtrees. The root keeps its balance and
+* size, which joinTree() resets when it is reused.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::splitRoot(Subtree t, Subtree& left, Subtree& right)
+{
+    AVLNode<Key, Value>* n = t.root;
+    left.root = n->getLeft();
+    left.height = n->getBalance() >= 0 ? t.height - 1 : t.height - 2;
+    right.root = n->getRight();
+    right.height = n->getBalance() <= 0 ? t.height - 1 : t.height - 2;
+    if (left.root != nullptr) left.root->setParent(nullptr);
+    if (right.root != nullptr) right.root->setParent(nullptr);
+    n->setLeft(nullptr);
+    n->setRight(nullptr);
+}
+
+/**
+* Joins left, the single node mid and right, where every key in left
+* orders before mid's and every key in right after it. Costs
+* O(|height(left) - height(right)| + 1).
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::joinTree(Subtree left, AVLNode<Key, Value>* mid, Subtree right)
+{
+    if (left.height > right.height + 1) return joinRight(left, mid, right);
+    if (right.height > left.height + 1) return joinLeft(left, mid, right);
+
+    mid->setParent(nullptr);
+    mid->setLeft(left.root);
+    if (left.root != nullptr) left.root->setParent(mid);
+    mid->setRight(right.root);
+    if (right.root != nullptr) right.root->setParent(mid);
+    mid->setBalance(left.height - right.height);
+    updateSize(mid, KeepSizes());
+    Subtree joined = { mid, std::max(left.height, right.height) + 1 };
+    return joined;
+}
+
+/**
+* joinTree() when left is the taller: walk down left's right spine to a
+* subtree no more than one taller than right, put mid there with that
+* subtree and right as its children, and rebalance on the way back up.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::joinRight(Subtree left, AVLNode<Key, Value>* mid, Subtree right)
+{
+    AVLNode<Key, Value>* parent = nullptr;
+    AVLNode<Key, Value>* curr = left.root;
+    int height = left.height;
+    while (height > right.height + 1) {
+        parent = curr;
+        height -= curr->getBalance() <= 0 ? 1 : 2;
+        curr = curr->getRight();
+    }
+
+    mid->setLeft(curr);
+    if (curr != nullptr) curr->setParent(mid);
+    mid->setRight(right.root);
+    if (right.root != nullptr) right.root->setParent(mid);
+    mid->setBalance(height - right.height);
+    updateSize(mid, KeepSizes());
+    parent->setRight(mid);
+    mid->setParent(parent);
+    updatePathSizes(parent, KeepSizes());
+
+    // parent's right subtree grew by one level
+    bool grew;
+    Subtree joined;
+    joined.root = growFix(parent, -1, grew);
+    joined.height = left.height + (grew ? 1 : 0);
+    return joined;
+}
+
+/**
+* The mirror image of joinRight(), for a taller right.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::joinLeft(Subtree left, AVLNode<Key, Value>* mid, Subtree right)
+{
+    AVLNode<Key, Value>* parent = nullptr;
+    AVLNode<Key, Value>* curr = right.root;
+    int height = right.height;
+    while (height > left.height + 1) {
+        parent = curr;
+        height -= curr->getBalance() >= 0 ? 1 : 2;
+        curr = curr->getLeft();
+    }
+
+    mid->setRight(curr);
+    if (curr != nullptr) curr->setParent(mid);
+    mid->setLeft(left.root);
+    if (left.root != nullptr) left.root->setParent(mid);
+    mid->setBalance(left.height - height);
+    updateSize(mid, KeepSizes());
+    parent->setLeft(mid);
+    mid->setParent(parent);
+    updatePathSizes(parent, KeepSizes());
+
+    bool grew;
+    Subtree joined;
+    joined.root = growFix(parent, 1, grew);
+    joined.height = right.height + (grew ? 1 : 0);
+    return joined;
+}
+
+/**
+* Rebalances upwards from n after one of its subtrees grew by a level
+* (diff is +1 for the left, -1 for the right) and returns the top of the
+* detached tree n is in; grew tells whether that tree got taller. Unlike
+* after an insert, a grown child can have balance 0 here, which needs a
+* single rotation that leaves the height grown.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::growFix(AVLNode<Key, Value>* n, int8_t diff, bool& grew)
+{
+    grew = false;
+    while (true) {
+        AVLNode<Key, Value>* p = n->getParent();
+        int8_t nextDiff = (p != nullptr && n == p->getLeft()) ? 1 : -1;
+        int8_t balance = n->getBalance() + diff;
+        bool taller;
+
+        if (balance == 0) {
+            n->setBalance(0);
+            taller = false;
+        }
+        else if (balance == 1 || balance == -1) {
+            n->setBalance(balance);
+            taller = true;
+        }
+        else if (balance == -2) {
+            AVLNode<Key, Value>* c = n->getRight();
+            if (c->getBalance() <= 0) {
+                taller = c->getBalance() == 0;
+                rotateLeftAt(n);
+                n->setBalance(taller ? -1 : 0);
+                c->setBalance(taller ? 1 : 0);
+            }
+            else {
+                AVLNode<Key, Value>* g = c->getLeft();
+                rotateRightAt(c);
+                rotateLeftAt(n);
+                n->setBalance(g->getBalance() == -1 ? 1 : 0);
+                c->setBalance(g->getBalance() == 1 ? -1 : 0);
+                g->setBalance(0);
+                taller = false;
+            }
+            n = n->getParent();
+        }
+        else {
+            AVLNode<Key, Value>* c = n->getLeft();
+            if (c->getBalance() >= 0) {
+                taller = c->getBalance() == 0;
+                rotateRightAt(n);
+                n->setBalance(taller ? 1 : 0);
+                c->setBalance(taller ? -1 : 0);
+            }
+            else {
+                AVLNode<Key, Value>* g = c->getRight();
+                rotateLeftAt(c);
+                rotateRightAt(n);
+                n->setBalance(g->getBalance() == 1 ? -1 : 0);
+                c->setBalance(g->getBalance() == -1 ? 1 : 0);
+                g->setBalance(0);
+                taller = false;
+            }
+            n = n->getParent();
+        }
+
+        if (p == nullptr) {
+            grew = taller;
+            return n;
+        }
+        if (!taller) break;
+        n = p;
+        diff = nextDiff;
+    }
+    while (n->getParent() != nullptr) n = n->getParent();
+    return n;
+}
+
+/**
+* Joins two subtrees with no node in between; every key in left must
+* order before every key in right. O(log n).
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::join2(Subtree left, Subtree right)
+{
+    if (left.root == nullptr) return right;
+    Subtree rest;
+    AVLNode<Key, Value>* last = splitLast(left, rest);
+    return joinTree(rest, last, right);
+}
+
+/**
+* Takes the node with the largest key out of t, leaving the rest in rest.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::splitLast(Subtree t, Subtree& rest)
+{
+    AVLNode<Key, Value>* n = t.root;
+    Subtree left, right;
+    splitRoot(t, left, right);
+    if (right.root == nullptr) {
+        rest = left;
+        return n;
+    }
+    Subtree rightRest;
+    AVLNode<Key, Value>* last = splitLast(right, rightRest);
+    rest = joinTree(left, n, rightRest);
+    return last;
+}
+
+/**
+* Splits t into the keys before key (left) and after it (right). Returns
+* the node holding key, cut loose, or nullptr if there is none. The
+* joins along the search path cost O(log n) in total.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare, Options>::splitTree(Subtree t, const Key& key,
+    Subtree& left, Subtree& right) const
+{
+    if (t.root == nullptr) {
+        left = t;
+        right = t;
+        return nullptr;
+    }
+    AVLNode<Key, Value>* n = t.root;
+    Subtree below, above;
+    splitRoot(t, below, above);
+    int cmp = compareKeys(this->comp_, key, n->getKey());
+    if (cmp == 0) {
+        left = below;
+        right = above;
+        return n;
+    }
+    if (cmp < 0) {
+        Subtree rest;
+        AVLNode<Key, Value>* found = splitTree(below, key, left, rest);
+        right = joinTree(rest, n, above);
+        return found;
+    }
+    Subtree rest;
+    AVLNode<Key, Value>* found = splitTree(above, key, rest, right);
+    left = joinTree(below, n, rest);
+    return found;
+}
+
+/**
+* Union of two detached subtrees: split b around a's root, take the
+* unions on each side (in parallel while threads and size allow) and
+* join them back around a's root. Of two equal keys a's node is kept,
+* with b's value if Replace is set.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+template<bool Replace>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::unionOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const
+{
+    if (a.root == nullptr) return b;
+    if (b.root == nullptr) return a;
+
+    AVLNode<Key, Value>* n = a.root;
+    Subtree aLeft, aRight, bLeft, bRight;
+    splitRoot(a, aLeft, aRight);
+    AVLNode<Key, Value>* dup = splitTree(b, n->getKey(), bLeft, bRight);
+    if (dup != nullptr) {
+        takeValue(n, dup, std::integral_constant<bool, Replace>());
+        dropSubtree(drop, dup);
+    }
+
+    Subtree left, right;
+    DropList leftDrop = { nullptr, nullptr };
+    unsigned leftThreads = threads / 2;
+    forkJoin(leftThreads > 0 && std::min(a.height, b.height) >= PARALLEL_MIN_HEIGHT,
+        [&]() { left = unionOf<Replace>(aLeft, bLeft, leftThreads, leftDrop); },
+        [&]() { right = unionOf<Replace>(aRight, bRight, threads - leftThreads, drop); });
+    appendDrops(drop, leftDrop);
+    return joinTree(left, n, right);
+}
+
+/**
+* Intersection of two detached subtrees, keeping a's items.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::intersectionOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const
+{
+    if (a.root == nullptr || b.root == nullptr) {
+        dropSubtree(drop, a.root);
+        dropSubtree(drop, b.root);
+        Subtree empty = { nullptr, 0 };
+        return empty;
+    }
+
+    AVLNode<Key, Value>* n = a.root;
+    Subtree aLeft, aRight, bLeft, bRight;
+    splitRoot(a, aLeft, aRight);
+    AVLNode<Key, Value>* dup = splitTree(b, n->getKey(), bLeft, bRight);
+
+    Subtree left, right;
+    DropList leftDrop = { nullptr, nullptr };
+    unsigned leftThreads = threads / 2;
+    forkJoin(leftThreads > 0 && std::min(a.height, b.height) >= PARALLEL_MIN_HEIGHT,
+        [&]() { left = intersectionOf(aLeft, bLeft, leftThreads, leftDrop); },
+        [&]() { right = intersectionOf(aRight, bRight, threads - leftThreads, drop); });
+    appendDrops(drop, leftDrop);
+    if (dup != nullptr) {
+        dropSubtree(drop, dup);
+        return joinTree(left, n, right);
+    }
+    dropSubtree(drop, n);
+    return join2(left, right);
+}
+
+/**
+* a minus b for two detached subtrees: split a around b's root and
+* subtract b's halves from a's.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::differenceOf(Subtree a, Subtree b, unsigned threads, DropList& drop) const
+{
+    if (a.root == nullptr || b.root == nullptr) {
+        dropSubtree(drop, b.root);
+        return a;
+    }
+
+    AVLNode<Key, Value>* n = b.root;
+    Subtree aLeft, aRight, bLeft, bRight;
+    splitRoot(b, bLeft, bRight);
+    AVLNode<Key, Value>* found = splitTree(a, n->getKey(), aLeft, aRight);
+    dropSubtree(drop, n);
+    if (found != nullptr) dropSubtree(drop, found);
+
+    Subtree left, right;
+    DropList leftDrop = { nullptr, nullptr };
+    unsigned leftThreads = threads / 2;
+    forkJoin(leftThreads > 0 && std::min(a.height, b.height) >= PARALLEL_MIN_HEIGHT,
+        [&]() { left = differenceOf(aLeft, bLeft, leftThreads, leftDrop); },
+        [&]() { right = differenceOf(aRight, bRight, threads - leftThreads, drop); });
+    appendDrops(drop, leftDrop);
+    return join2(left, right);
+}
+
+/**
+* Moves from's value into to.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::takeValue(AVLNode<Key, Value>* to, AVLNode<Key, Value>* from, std::true_type)
+{
+    to->setValue(std::move(from->getValue()));
+}
+
+/**
+* Removes the keys in the sorted, duplicate-free run [first, last) from
+* the detached subtree t: the difference recursion of differenceOf(),
+* with the run split by binary search instead of by a second tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::Subtree
+AVLTree<Key, Value, Compare, Options>::eraseSorted(Subtree t, const Key* first, const Key* last,
+    unsigned threads, DropList& drop) const
+{
+    if (t.root == nullptr || first == last) return t;
+
+    AVLNode<Key, Value>* n = t.root;
+    Subtree below, above;
+    splitRoot(t, below, above);
+    const Key* mid = std::lower_bound(first, last, n->getKey(), this->comp_);
+    bool found = mid != last && !this->comp_(n->getKey(), *mid);
+
+    Subtree left, right;
+    DropList leftDrop = { nullptr, nullptr };
+    unsigned leftThreads = threads / 2;
+    forkJoin(leftThreads > 0 && t.height >= PARALLEL_MIN_HEIGHT && last - first >= (1 << PARALLEL_MIN_HEIGHT),
+        [&]() { left = eraseSorted(below, first, mid, leftThreads, leftDrop); },
+        [&]() { right = eraseSorted(above, found ? mid + 1 : mid, last, threads - leftThreads, drop); });
+    appendDrops(drop, leftDrop);
+    if (found) {
+        dropSubtree(drop, n);
+        return join2(left, right);
+    }
+    return joinTree(left, n, right);
+}
+
+/**
+* Adds a detached subtree (or single node) to drop.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::dropSubtree(DropList& drop, Node<Key, Value>* n)
+{
+    if (n == nullptr) return;
+    n->setParent(nullptr);
+    if (drop.tail != nullptr) drop.tail->setParent(n);
+    else drop.head = n;
+    drop.tail = n;
+}
+
+/**
+* Moves everything in more to the end of drop.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::appendDrops(DropList& drop, DropList& more)
+{
+    if (more.head == nullptr) return;
+    if (drop.tail != nullptr) drop.tail->setParent(more.head);
+    else drop.head = more.head;
+    drop.tail = more.tail;
+    more.head = more.tail = nullptr;
+}
+
+/**
+* Destroys every dropped subtree.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::destroyDropped(DropList& drop)
+{
+    Node<Key, Value>* n = drop.head;
+    while (n != nullptr) {
+        Node<Key, Value>* next = n->getParent();
+        this->deleteTree(n);
+        n = next;
+    }
+    drop.head = drop.tail = nullptr;
+}
+
+/**
+* Recomputes the sizes from n up to the top of its tree.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::updatePathSizes(AVLNode<Key, Value>* n, std::true_type)
+{
+    for (; n != nullptr; n = n->getParent()) {
+        updateSize(n, std::true_type());
+    }
+}
+
+/**
+* Where ThreadLinks sit inside a TreeNode. offsetof is only guaranteed for
+* standard-layout types, so this measures it on uninitialized storage.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+std::size_t AVLTree<Key, Value, Compare, Options>::linksOffset(std::true_type)
+{
+    typename std::aligned_storage<sizeof(TreeNode), alignof(TreeNode)>::type slot;
+    TreeNode* n = reinterpret_cast<TreeNode*>(&slot);
+    return reinterpret_cast<char*>(&n->getLinks()) - reinterpret_cast<char*>(n);
+}
+
+/**
+* The neighbour links of a node; only used when threaded.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+ThreadLinks<Key, Value>& AVLTree<Key, Value, Compare, Options>::links(Node<Key, Value>* n)
+{
+    return static_cast<TreeNode*>(n)->getLinks();
+}
+
+/**
+* Makes next follow prev in the thread; either may be null at the ends.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadPair(Node<Key, Value>* prev, Node<Key, Value>* next)
+{
+    if (prev != nullptr) links(prev).next = next;
+    if (next != nullptr) links(next).prev = prev;
+}
+
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadPair(Node<Key, Value>* prev, Node<Key, Value>* next, std::true_type)
+{
+    threadPair(prev, next);
+}
+
+/**
+* Threads a new leaf in next to its parent: a left child comes just
+* before its parent, a right child just after.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadIn(AVLNode<Key, Value>* n, std::true_type)
+{
+    AVLNode<Key, Value>* parent = n->getParent();
+    if (parent == nullptr) return;
+    if (n == parent->getLeft()) {
+        threadPair(links(parent).prev, n);
+        threadPair(n, parent);
+    }
+    else {
+        threadPair(n, links(parent).next);
+        threadPair(parent, n);
+    }
+}
+
+/**
+* Unthreads a node that is about to be destroyed.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadOut(AVLNode<Key, Value>* n, std::true_type)
+{
+    threadPair(links(n).prev, links(n).next);
+}
+
+/**
+* Trades the thread positions of two nodes, to match nodeSwap. They may
+* be neighbours.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2, std::true_type)
+{
+    Node<Key, Value>* prev1 = links(n1).prev;
+    Node<Key, Value>* next1 = links(n1).next;
+    Node<Key, Value>* prev2 = links(n2).prev;
+    Node<Key, Value>* next2 = links(n2).next;
+    if (next1 == n2) {
+        threadPair(prev1, n2);
+        threadPair(n2, n1);
+        threadPair(n1, next2);
+    }
+    else if (next2 == n1) {
+        threadPair(prev2, n1);
+        threadPair(n1, n2);
+        threadPair(n2, next1);
+    }
+    else {
+        threadPair(prev1, n2);
+        threadPair(n2, next1);
+        threadPair(prev2, n1);
+        threadPair(n1, next2);
+    }
+}
+
+/**
+* Threads the whole tree in one in-order walk, after a bulk build.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+void AVLTree<Key, Value, Compare, Options>::threadAll(std::true_type)
+{
+    Node<Key, Value>* prev = nullptr;
+    for (Node<Key, Value>* n = this->getSmallestNode(); n != nullptr; n = this->successor(n)) {
+        threadPair(prev, n);
+        prev = n;
+    }
+    if (prev != nullptr) links(prev).next = nullptr;
+}
+
+/**
+* Number of items in the tree, in O(1).
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+std::size_t AVLTree<Key, Value, Compare, Options>::size() const
+{
+    static_assert(Options::orderStatistics, "size() needs AVLOptions<true>");
+    return subtreeSize(this->root_);
+}
+
+/**
+* Number of keys that order before key, whether or not key is present.
+* Adds up the left subtrees passed over on the way down.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+std::size_t AVLTree<Key, Value, Compare, Options>::rank(const Key& key) const
+{
+    static_assert(Options::orderStatistics, "rank() needs AVLOptions<true>");
+    std::size_t before = 0;
+    Node<Key, Value>* curr = this->root_;
+    while (curr != nullptr) {
+        int cmp = compareKeys(this->comp_, key, curr->getKey());
+        if (cmp == 0) {
+            return before + subtreeSize(curr->getLeft());
+        }
+        if (cmp < 0) {
+            curr = curr->getLeft();
+        }
+        else {
+            before += subtreeSize(curr->getLeft()) + 1;
+            curr = curr->getRight();
+        }
+    }
+    return before;
+}
+
+/**
+* The item at position i (0-based) in key order, or end() if i >= size().
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+typename AVLTree<Key, Value, Compare, Options>::iterator
+AVLTree<Key, Value, Compare, Options>::select(std::size_t i) const
+{
+    static_assert(Options::orderStatistics, "select() needs AVLOptions<true>");
+    Node<Key, Value>* curr = this->root_;
+    while (curr != nullptr) {
+        std::size_t leftSize = subtreeSize(curr->getLeft());
+        if (i < leftSize) {
+            curr = curr->getLeft();
+        }
+        else if (i == leftSize) {
+            break;
+        }
+        else {
+            i -= leftSize + 1;
+            curr = curr->getRight();
+        }
+    }
+    return this->makeIterator(curr);
+}
+
+/**
+* Number of keys with lo <= key < hi; 0 unless lo orders before hi.
+*/
+template<typename Key, typename Value, typename Compare, typename Options>
+std::size_t AVLTree<Key, Value, Compare, Options>::count_range(const Key& lo, const Key& hi) const
+{
+    static_assert(Options::orderStatistics, "count_range() needs AVLOptions<true>");
+    if (!this->comp_(lo, hi)) return 0;
+    return rank(hi) - rank(lo);
 }
 
 
@@ -0,0 +1,1362 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "concurrent_avlbst.h"
+#include "persistent_avlbst.h"
+#include "btree.h"
+#include "eytzinger_index.h"
+
+using namespace std;
+
+/*
+ * Micro-benchmarks for the search trees.
+ * Usage: bst-bench <benchmark> <tree> [n]
+ * Each run measures a single tree type so that RSS numbers are not
+ * polluted by memory the allocator kept from an earlier run.
+ */
+
+typedef chrono::steady_clock Clock;
+
+// B-tree engines: nodes of four cache lines, and of a page
+typedef BTreeMap<int, int> BTree;
+typedef BTreeMap<int, int, less<int>, 4096> PageBTree;
+
+double elapsedNs(Clock::time_point start)
+{
+    return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+// resident set size of this process in bytes
+long residentBytes()
+{
+    ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Counts last-level cache misses of this thread with perf_event_open.
+ * Reads as -1 where the kernel does not allow it (containers, VMs).
+ */
+class CacheMissCounter
+{
+public:
+    CacheMissCounter() : fd_(-1)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CacheMissCounter() { if (fd_ >= 0) close(fd_); }
+    void start()
+    {
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    long long stop()
+    {
+        if (fd_ < 0) return -1;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(fd_, &count, sizeof(count)) != sizeof(count)) return -1;
+        return count;
+    }
+private:
+    long fd_;
+};
+
+vector<int> randomKeys(size_t n, unsigned seed)
+{
+    mt19937 rng(seed);
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(rng());
+    }
+    return keys;
+}
+
+/**
+ * count probes drawn from keys with Zipf(s) popularity: the key of rank
+ * r comes up with weight 1 / r^s. Ranks are dealt to keys in random
+ * order, so the hot keys are spread over the whole tree.
+ */
+vector<int> zipfProbes(const vector<int>& keys, size_t count, double s, unsigned seed)
+{
+    size_t n = keys.size();
+    vector<double> cdf(n);
+    double total = 0;
+    for (size_t r = 0; r < n; r++) {
+        total += 1.0 / pow(double(r + 1), s);
+        cdf[r] = total;
+    }
+    mt19937 rng(seed);
+    vector<size_t> order(n);
+    iota(order.begin(), order.end(), size_t(0));
+    shuffle(order.begin(), order.end(), rng);
+    uniform_real_distribution<double> pick(0, total);
+    vector<int> probes(count);
+    for (size_t i = 0; i < count; i++) {
+        size_t r = lower_bound(cdf.begin(), cdf.end(), pick(rng)) - cdf.begin();
+        probes[i] = keys[order[std::min(r, n - 1)]];
+    }
+    return probes;
+}
+
+void report(const char* bench, const char* tree, const char* what, double value, const char* unit)
+{
+    cout << bench << "\t" << tree << "\t" << what << "\t" << value << " " << unit << endl;
+}
+
+// thin adapters so every benchmark can drive std::map with the same calls
+template<typename Tree>
+void treeInsert(Tree& t, int key, int value) { t.insert(std::make_pair(key, value)); }
+template<typename Tree>
+void treeRemove(Tree& t, int key) { t.remove(key); }
+void treeRemove(map<int, int>& t, int key) { t.erase(key); }
+
+/**
+ * Allocation churn: build a tree of n random keys, then repeatedly remove
+ * one key and insert a fresh one, then clear the tree.
+ */
+template<typename Tree>
+void benchAlloc(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> fresh = randomKeys(n, 2);
+    long rssBefore = residentBytes();
+
+    Tree t;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+    report("alloc", name, "insert", elapsedNs(start) / n, "ns/op");
+    report("alloc", name, "rss", double(residentBytes() - rssBefore) / n, "bytes/entry");
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        treeRemove(t, keys[i]);
+        treeInsert(t, fresh[i], i);
+    }
+    report("alloc", name, "churn", elapsedNs(start) / (2 * n), "ns/op");
+
+    start = Clock::now();
+    t.clear();
+    report("alloc", name, "clear", elapsedNs(start) / n, "ns/entry");
+}
+
+/**
+ * Lookup throughput: build a tree of n random keys, then look up n keys of
+ * which half are present and half are (almost certainly) missing.
+ */
+template<typename Tree>
+void benchFind(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> probes = randomKeys(n, 3);
+    mt19937 rng(4);
+    for (size_t i = 0; i < n; i += 2) {
+        probes[i] = keys[rng() % n];
+    }
+
+    Tree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+
+    // small trees are probed repeatedly so the timing is not all noise
+    size_t lookups = std::max(n, size_t(4000000));
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.find(probes[i % n]) != t.end()) found++;
+    }
+    double ns = elapsedNs(start);
+    report("find", name, "lookup", ns / lookups, "ns/op");
+    report("find", name, "throughput", lookups / ns * 1000.0, "Mops/s");
+    if (found < lookups / 2) cerr << "find: lost keys" << endl;
+}
+
+/**
+ * Batched lookups the way a request handler issues them: batches of 32,
+ * 128 and 512 keys (half hits) through a find() loop and through
+ * find_many().
+ */
+template<typename Tree>
+void benchFindMany(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> probes = randomKeys(n, 3);
+    mt19937 rng(4);
+    for (size_t i = 0; i < n; i += 2) {
+        probes[i] = keys[rng() % n];
+    }
+    Tree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+
+    size_t lookups = std::max(n, size_t(4000000));
+    const size_t batches[] = { 32, 128, 512 };
+    for (size_t b = 0; b < 3; b++) {
+        size_t batch = batches[b];
+        size_t rounds = lookups / batch;
+        vector<typename Tree::iterator> out(batch);
+        size_t looped = 0, many = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t r = 0; r < rounds; r++) {
+            size_t offset = (r * batch) % (n - batch + 1);
+            for (size_t i = 0; i < batch; i++) {
+                out[i] = t.find(probes[offset + i]);
+            }
+            for (size_t i = 0; i < batch; i++) {
+                if (out[i] != t.end()) looped++;
+            }
+        }
+        string what = "find loop, batch " + to_string(batch);
+        report("findmany", name, what.c_str(), elapsedNs(start) / (rounds * batch), "ns/key");
+
+        start = Clock::now();
+        for (size_t r = 0; r < rounds; r++) {
+            size_t offset = (r * batch) % (n - batch + 1);
+            t.find_many(probes.begin() + offset, probes.begin() + offset + batch, out.begin());
+            for (size_t i = 0; i < batch; i++) {
+                if (out[i] != t.end()) many++;
+            }
+        }
+        what = "find_many, batch " + to_string(batch);
+        report("findmany", name, what.c_str(), elapsedNs(start) / (rounds * batch), "ns/key");
+        if (looped != many) cerr << "findmany: results differ" << endl;
+    }
+}
+
+/**
+ * String-key lookups. Keys share a long prefix, as path- or URL-like keys
+ * do, so every comparison costs a real scan; half the probes miss.
+ */
+template<typename Tree>
+void benchStringFind(const char* name, size_t n)
+{
+    vector<int> ids = randomKeys(n, 1);
+    vector<int> missing = randomKeys(n, 3);
+    vector<string> keys(n), probes(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = "/srv/data/objects/" + to_string(ids[i]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        probes[i] = (i % 2 == 0) ? keys[(i * 7919) % n] : "/srv/data/objects/" + to_string(missing[i]) + "~";
+    }
+
+    Tree t;
+    for (size_t i = 0; i < n; i++) {
+        t.insert(std::make_pair(keys[i], static_cast<int>(i)));
+    }
+
+    size_t lookups = std::max(n, size_t(4000000));
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.find(probes[i % n]) != t.end()) found++;
+    }
+    double ns = elapsedNs(start);
+    report("strfind", name, "lookup", ns / lookups, "ns/op");
+    if (found < lookups / 2) cerr << "strfind: lost keys" << endl;
+}
+
+/**
+ * Memory footprint and cache behaviour at scale: node size, pool bytes per
+ * entry, RSS per entry, and lookup latency / cache misses per lookup.
+ */
+template<typename Tree, typename NodeType>
+void benchMemory(const char* name, size_t n)
+{
+    report("memory", name, "sizeof(node)", sizeof(NodeType), "bytes");
+    long rssBefore = residentBytes();
+    Tree t;
+    mt19937 rng(1);
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, static_cast<int>(rng()), i);
+    }
+    report("memory", name, "pool", double(t.bytesReserved()) / n, "bytes/entry");
+    report("memory", name, "rss", double(residentBytes() - rssBefore) / n, "bytes/entry");
+
+    size_t lookups = 1000000;
+    vector<int> probes = randomKeys(lookups, 1);
+    CacheMissCounter misses;
+    size_t found = 0;
+    misses.start();
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.find(probes[i]) != t.end()) found++;
+    }
+    double ns = elapsedNs(start);
+    long long missCount = misses.stop();
+    report("memory", name, "lookup", ns / lookups, "ns/op");
+    if (missCount >= 0) report("memory", name, "llc-misses", double(missCount) / lookups, "per lookup");
+    else cout << "memory\t" << name << "\tllc-misses\tn/a (perf_event_open unavailable)" << endl;
+    if (found == 0) cerr << "memory: lost keys" << endl;
+}
+
+/**
+ * Copying a tree of n random keys: the copy constructor against building
+ * a new tree by inserting every item again, and a move for scale.
+ */
+template<typename Tree>
+void benchCopy(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    Tree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        Tree copy(t);
+        report("copy", name, "copy", elapsedNs(start) / n, "ns/entry");
+        if (copy.begin()->first != t.begin()->first) cerr << "copy: wrong contents" << endl;
+    }
+
+    // in the original order: sorted inserts would turn the plain BST into
+    // a list
+    start = Clock::now();
+    {
+        Tree rebuilt;
+        for (size_t i = 0; i < n; i++) {
+            treeInsert(rebuilt, keys[i], i);
+        }
+        report("copy", name, "reinsert", elapsedNs(start) / n, "ns/entry");
+    }
+
+    start = Clock::now();
+    Tree moved(std::move(t));
+    report("copy", name, "move", elapsedNs(start), "ns");
+}
+
+/**
+ * Times full in-order scans of c, forwards and backwards, summing the
+ * values so the loads cannot be skipped. Small containers are scanned
+ * repeatedly so the timing is not all noise.
+ */
+template<typename Container>
+void timeScan(const char* name, const Container& c, size_t n)
+{
+    size_t passes = std::max(size_t(1), size_t(4000000) / std::max(n, size_t(1)));
+    size_t count = 0;
+    long long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+        for (typename Container::const_iterator it = c.begin(); it != c.end(); ++it) {
+            sum += it->second;
+            count++;
+        }
+    }
+    double ns = elapsedNs(start);
+    report("scan", name, "forward", ns / count, "ns/entry");
+    report("scan", name, "throughput", count / ns * 1000.0, "Mentries/s");
+
+    // rend() is built from begin(), an O(log n) descent in the trees, so
+    // it is hoisted out of the loop
+    long long backSum = 0;
+    typename Container::const_reverse_iterator rend = c.rend();
+    start = Clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+        for (typename Container::const_reverse_iterator it = c.rbegin(); it != rend; ++it) {
+            backSum += it->second;
+        }
+    }
+    report("scan", name, "backward", elapsedNs(start) / count, "ns/entry");
+    if (backSum != sum) cerr << "scan: forward and backward scans disagree" << endl;
+}
+
+/**
+ * Scan throughput over n random keys. The nodes are allocated in
+ * insertion order, not key order, so like a long-lived tree a scan
+ * jumps around the heap.
+ */
+template<typename Tree>
+void benchScan(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    Tree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+    timeScan(name, t, n);
+}
+
+/**
+ * The same items in a sorted vector: the floor for any scan.
+ */
+void benchScanVector(size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    map<int, int> unique;
+    for (size_t i = 0; i < n; i++) {
+        unique[keys[i]] = i;
+    }
+    vector<pair<int, int> > items(unique.begin(), unique.end());
+    timeScan("vector", items, n);
+}
+
+/**
+ * Range queries [lo, lo + width) over keys 0..n-1: range() against
+ * walking from begin(), skipping keys below lo and stopping at hi.
+ */
+void benchRange(size_t n)
+{
+    vector<pair<int, int> > items(n);
+    for (size_t i = 0; i < n; i++) {
+        items[i] = make_pair(static_cast<int>(i), 1);
+    }
+    AVLTree<int, int> t;
+    t.assign_sorted(items.begin(), items.end());
+
+    const int widths[] = { 10, 1000 };
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        int width = widths[w];
+        vector<int> starts = randomKeys(100000, 6);
+        for (size_t i = 0; i < starts.size(); i++) {
+            starts[i] = static_cast<unsigned>(starts[i]) % n;
+        }
+        string what = "width " + to_string(width);
+
+        long long sum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t q = 0; q < starts.size(); q++) {
+            BinarySearchTree<int, int>::range_view r = t.range(starts[q], starts[q] + width);
+            for (BinarySearchTree<int, int>::iterator it = r.begin(); it != r.end(); ++it) {
+                sum += it->second;
+            }
+        }
+        report("range", (what + " range()").c_str(), "query", elapsedNs(start) / starts.size(), "ns/op");
+
+        // the full walk is O(n) per query, so it gets fewer queries
+        size_t scans = std::min(starts.size(), std::max(size_t(10), size_t(100000000) / n));
+        long long scanSum = 0, rangeSum = 0;
+        start = Clock::now();
+        for (size_t q = 0; q < scans; q++) {
+            int hi = starts[q] + width;
+            for (AVLTree<int, int>::iterator it = t.begin(); it != t.end() && it->first < hi; ++it) {
+                if (it->first >= starts[q]) scanSum += it->second;
+            }
+        }
+        report("range", (what + " scan").c_str(), "query", elapsedNs(start) / scans, "ns/op");
+
+        // both must have seen the same items
+        for (size_t q = 0; q < scans; q++) {
+            BinarySearchTree<int, int>::range_view r = t.range(starts[q], starts[q] + width);
+            for (BinarySearchTree<int, int>::iterator it = r.begin(); it != r.end(); ++it) {
+                rangeSum += it->second;
+            }
+        }
+        if (scanSum != rangeSum || sum == 0) cerr << "range: results differ" << endl;
+    }
+
+    // "latest 100 entries": walk back from rbegin() against copying
+    // everything out and taking the tail
+    const size_t latest = 100;
+    const size_t tailQueries = 1000;
+    long long sum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t q = 0; q < tailQueries; q++) {
+        size_t k = 0;
+        for (AVLTree<int, int>::const_reverse_iterator it = t.crbegin(); it != t.crend() && k < latest; ++it, ++k) {
+            sum += it->first;
+        }
+    }
+    report("range", "latest 100 rbegin()", "query", elapsedNs(start) / tailQueries, "ns/op");
+
+    size_t queries = std::max(size_t(10), size_t(100000000) / n);
+    long long copySum = 0;
+    start = Clock::now();
+    for (size_t q = 0; q < queries; q++) {
+        vector<pair<int, int> > all(t.begin(), t.end());
+        for (size_t i = all.size() - std::min(latest, all.size()); i < all.size(); i++) {
+            copySum += all[i].first;
+        }
+    }
+    report("range", "latest 100 copy-out", "query", elapsedNs(start) / queries, "ns/op");
+    if (sum / static_cast<long long>(tailQueries) != copySum / static_cast<long long>(queries)) cerr << "range: latest entries differ" << endl;
+}
+
+/**
+ * Cold-start load of n items, sorted and shuffled: one insert per item
+ * against the bulk loaders.
+ */
+void benchLoad(size_t n, unsigned threads)
+{
+    vector<pair<int, int> > items(n);
+    for (size_t i = 0; i < n; i++) {
+        items[i] = make_pair(static_cast<int>(i), static_cast<int>(i));
+    }
+    for (int shuffled = 0; shuffled < 2; shuffled++) {
+        const char* order = shuffled ? "shuffled" : "sorted";
+        if (shuffled) {
+            mt19937 rng(5);
+            shuffle(items.begin(), items.end(), rng);
+        }
+        {
+            AVLTree<int, int> t;
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < n; i++) {
+                t.insert(items[i]);
+            }
+            report("load", order, "insert", elapsedNs(start) / 1e6, "ms");
+        }
+        {
+            AVLTree<int, int> t;
+            Clock::time_point start = Clock::now();
+            if (shuffled) t.assign(items.begin(), items.end(), threads);
+            else t.assign_sorted(items.begin(), items.end());
+            report("load", order, shuffled ? "assign" : "assign_sorted", elapsedNs(start) / 1e6, "ms");
+        }
+    }
+}
+
+/**
+ * Set operations on two AVLTrees of random keys, n and n / ratio items
+ * (ratio 1 and 1000): unite/intersect/subtract on 1 to 32 threads,
+ * against the loop of inserts or removes they replace. Each run works on
+ * fresh copies, which are not timed. Last, join() of a one-item tree
+ * that has freed n nodes, which should cost no more than one that has
+ * freed none: the right tree's whole pool is taken over.
+ */
+void benchSetOps(size_t n)
+{
+    typedef AVLTree<int, int> Tree;
+    const size_t ratios[] = { 1, 1000 };
+    for (size_t r = 0; r < 2; r++) {
+        size_t m = std::max(size_t(1), n / ratios[r]);
+        vector<int> keysA = randomKeys(n, 1);
+        vector<int> keysB = randomKeys(m, 2);
+        // let about half of b's keys also be in a
+        for (size_t i = 0; i < m; i += 2) {
+            keysB[i] = keysA[(i * 7919) % n];
+        }
+        Tree a, b;
+        for (size_t i = 0; i < n; i++) treeInsert(a, keysA[i], i);
+        for (size_t i = 0; i < m; i++) treeInsert(b, keysB[i], i);
+        string sizes = to_string(n) + "+" + to_string(m);
+
+        Clock::time_point start;
+        {
+            Tree out(a);
+            start = Clock::now();
+            for (Tree::iterator it = b.begin(); it != b.end(); ++it) out.try_emplace(it->first, it->second);
+            report("setops", sizes.c_str(), "union loop", elapsedNs(start) / 1e6, "ms");
+        }
+        {
+            Tree out(a);
+            start = Clock::now();
+            for (Tree::iterator it = b.begin(); it != b.end(); ++it) out.remove(it->first);
+            report("setops", sizes.c_str(), "difference loop", elapsedNs(start) / 1e6, "ms");
+        }
+
+        for (unsigned threads = 1; threads <= 32; threads *= 2) {
+            string label = to_string(threads) + (threads == 1 ? " thread" : " threads");
+            for (int op = 0; op < 3; op++) {
+                Tree out(a), other(b);
+                start = Clock::now();
+                if (op == 0) out.unite(other, threads);
+                else if (op == 1) out.intersect(other, threads);
+                else out.subtract(other, threads);
+                double ms = elapsedNs(start) / 1e6;
+                const char* what = op == 0 ? "union" : op == 1 ? "intersection" : "difference";
+                report("setops", sizes.c_str(), (string(what) + " " + label).c_str(), ms, "ms");
+            }
+        }
+    }
+
+    for (size_t freed = 0; freed <= n; freed += n) {
+        Tree left, right;
+        treeInsert(left, 0, 0);
+        for (size_t i = 0; i < freed; i++) treeInsert(right, int(i) + 1, 0);
+        for (size_t i = 0; i < freed; i++) right.remove(int(i) + 1);
+        treeInsert(right, 1, 0);
+        Clock::time_point start = Clock::now();
+        left.join(right);
+        report("setops", ("1+1, " + to_string(freed) + " freed").c_str(), "join", elapsedNs(start) / 1e6, "ms");
+    }
+}
+
+/**
+ * Batches of 10k to n random keys against an AVLTree of n items: the
+ * insert()/remove() loop an ingest path would run vs insert_batch and
+ * erase_batch on 1 and 4 threads. Each run starts from a fresh copy.
+ */
+void benchBatch(size_t n)
+{
+    typedef AVLTree<int, int> Tree;
+    vector<int> keys = randomKeys(n, 1);
+    Tree base;
+    for (size_t i = 0; i < n; i++) treeInsert(base, keys[i], i);
+
+    for (size_t k = 10000; k <= n; k *= 10) {
+        vector<int> fresh = randomKeys(k, 2);
+        vector<pair<int, int> > batch;
+        for (size_t i = 0; i < k; i++) batch.push_back(make_pair(fresh[i], int(i)));
+        // erase a mix of present and absent keys
+        vector<int> doomed(fresh);
+        for (size_t i = 0; i < k; i += 2) doomed[i] = keys[(i * 7919) % n];
+        string sizes = to_string(n) + "+" + to_string(k);
+
+        Clock::time_point start;
+        {
+            Tree t(base);
+            start = Clock::now();
+            for (size_t i = 0; i < k; i++) t.insert(batch[i]);
+            report("batch", sizes.c_str(), "insert loop", elapsedNs(start) / 1e6, "ms");
+        }
+        {
+            Tree t(base);
+            start = Clock::now();
+            for (size_t i = 0; i < k; i++) t.remove(doomed[i]);
+            report("batch", sizes.c_str(), "remove loop", elapsedNs(start) / 1e6, "ms");
+        }
+        for (unsigned threads = 1; threads <= 4; threads *= 4) {
+            string label = to_string(threads) + (threads == 1 ? " thread" : " threads");
+            {
+                Tree t(base);
+                start = Clock::now();
+                t.insert_batch(batch.begin(), batch.end(), threads);
+                report("batch", sizes.c_str(), ("insert_batch " + label).c_str(), elapsedNs(start) / 1e6, "ms");
+            }
+            {
+                Tree t(base);
+                start = Clock::now();
+                t.erase_batch(doomed.begin(), doomed.end(), threads);
+                report("batch", sizes.c_str(), ("erase_batch " + label).c_str(), elapsedNs(start) / 1e6, "ms");
+            }
+        }
+    }
+}
+
+/**
+ * A timestamp-ordered ingest stream: n events 16 ticks apart, of which
+ * one in ten arrives late by up to 1000 events. Inserts it into an
+ * AVLTree with plain insert(), with hint end(), and with the previous
+ * insert's iterator as the hint, and into std::map with and without the
+ * end() hint. Then looks up keys among the latest 1000 with find() and
+ * with find(end(), key), and replays every 8th event in order with
+ * find() and with the previous result as the hint.
+ */
+void benchIngest(size_t n)
+{
+    typedef AVLTree<int, int> Tree;
+    mt19937 rng(1);
+    vector<int> stream(n);
+    for (size_t i = 0; i < n; i++) {
+        size_t late = rng() % 10 == 0 ? rng() % std::min(i + 1, size_t(1000)) : 0;
+        stream[i] = int(16 * (i - late) + (late != 0 ? 1 + rng() % 15 : 0));
+    }
+
+    Clock::time_point start;
+    {
+        Tree t;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++) t.insert(make_pair(stream[i], int(i)));
+        report("ingest", "avl", "insert", elapsedNs(start) / n, "ns/op");
+    }
+    {
+        Tree t;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++) t.insert(t.end(), make_pair(stream[i], int(i)));
+        report("ingest", "avl", "insert(end())", elapsedNs(start) / n, "ns/op");
+    }
+    Tree t;
+    start = Clock::now();
+    Tree::iterator hint = t.end();
+    for (size_t i = 0; i < n; i++) hint = t.insert(hint, make_pair(stream[i], int(i)));
+    report("ingest", "avl", "insert(previous)", elapsedNs(start) / n, "ns/op");
+    {
+        map<int, int> m;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++) m.insert(make_pair(stream[i], int(i)));
+        report("ingest", "map", "insert", elapsedNs(start) / n, "ns/op");
+    }
+    {
+        map<int, int> m;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++) m.insert(m.end(), make_pair(stream[i], int(i)));
+        report("ingest", "map", "insert(end())", elapsedNs(start) / n, "ns/op");
+    }
+
+    size_t lookups = std::max(n, size_t(4000000));
+    vector<int> recent(lookups);
+    for (size_t i = 0; i < lookups; i++) recent[i] = stream[n - 1 - rng() % std::min(n, size_t(1000))];
+    size_t found = 0, fingerFound = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.find(recent[i]) != t.end()) found++;
+    }
+    report("ingest", "avl", "find, latest 1000", elapsedNs(start) / lookups, "ns/op");
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.find(t.end(), recent[i]) != t.end()) fingerFound++;
+    }
+    report("ingest", "avl", "find(end()), latest 1000", elapsedNs(start) / lookups, "ns/op");
+
+    // a replay: every 8th event looked up in timestamp order
+    vector<int> replay;
+    for (Tree::iterator it = t.begin(); it != t.end(); ++it) {
+        if (rng() % 8 == 0) replay.push_back(it->first);
+    }
+    start = Clock::now();
+    for (size_t i = 0; i < replay.size(); i++) {
+        if (t.find(replay[i]) != t.end()) found++;
+    }
+    report("ingest", "avl", "find, replay", elapsedNs(start) / replay.size(), "ns/op");
+    start = Clock::now();
+    hint = t.begin();
+    for (size_t i = 0; i < replay.size(); i++) {
+        hint = t.find(hint, replay[i]);
+        if (hint != t.end()) fingerFound++;
+    }
+    report("ingest", "avl", "find(previous), replay", elapsedNs(start) / replay.size(), "ns/op");
+    if (found != lookups + replay.size() || fingerFound != found) cerr << "ingest: lost keys" << endl;
+}
+
+/**
+ * Update/lookup mixes, n operations each on a fresh tree of n random
+ * keys: insert-heavy (75% inserts of new keys, 5% removes, 20% lookups),
+ * delete-heavy (5/75/20) and lookup-heavy (5/5/90). Removes take keys
+ * that are present; half the lookups hit.
+ */
+template<typename Tree>
+void benchMix(const char* name, size_t n)
+{
+    struct Mix { const char* what; unsigned inserts, removes; };
+    const Mix mixes[] = { { "insert-heavy", 75, 5 }, { "delete-heavy", 5, 75 }, { "lookup-heavy", 5, 5 } };
+    enum { INSERT, REMOVE, LOOKUP };
+    vector<int> keys = randomKeys(2 * n, 1);
+    for (size_t m = 0; m < 3; m++) {
+        // draw the operations up front so only the tree is timed
+        mt19937 rng(2);
+        vector<int> present(keys.begin(), keys.begin() + n);
+        vector<pair<int, int> > ops(n);
+        size_t fresh = n;
+        for (size_t i = 0; i < n; i++) {
+            unsigned roll = rng() % 100;
+            if (roll < mixes[m].inserts) {
+                ops[i] = make_pair(int(INSERT), keys[fresh++]);
+                present.push_back(ops[i].second);
+            }
+            else if (roll < mixes[m].inserts + mixes[m].removes) {
+                size_t at = rng() % present.size();
+                ops[i] = make_pair(int(REMOVE), present[at]);
+                present[at] = present.back();
+                present.pop_back();
+            }
+            else {
+                ops[i] = make_pair(int(LOOKUP), rng() % 2 ? present[rng() % present.size()] : int(rng()));
+            }
+        }
+
+        Tree t;
+        for (size_t i = 0; i < n; i++) treeInsert(t, keys[i], i);
+        size_t found = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) {
+            if (ops[i].first == INSERT) treeInsert(t, ops[i].second, i);
+            else if (ops[i].first == REMOVE) treeRemove(t, ops[i].second);
+            else if (t.find(ops[i].second) != t.end()) found++;
+        }
+        report("mix", name, mixes[m].what, elapsedNs(start) / n, "ns/op");
+        if (found == 0) cerr << "mix: lost keys" << endl;
+    }
+}
+
+/**
+ * Removing runs of neighbouring keys from a tree of the keys 0..n-1,
+ * inserted in random order. For runs of 100, 10k and n/10 keys, clears
+ * 10% of the tree run by run with a remove() per key and with one
+ * erase(first, last) per run. Then a scan that drops every other item,
+ * with remove(key) and with erase(iterator). All in ns per item removed.
+ */
+template<typename Tree>
+void benchErase(const char* name, size_t n)
+{
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    mt19937 rng(1);
+    shuffle(order.begin(), order.end(), rng);
+    Tree base;
+    for (size_t i = 0; i < n; i++) treeInsert(base, order[i], i);
+
+    size_t sizes[] = { 100, 10000, n / 10 };
+    for (size_t s = 0; s < 3; s++) {
+        size_t k = sizes[s];
+        if (k == 0 || k > n / 10) continue;
+        // disjoint runs at random places, n/10 keys in all
+        vector<int> starts(n / k);
+        for (size_t i = 0; i < starts.size(); i++) starts[i] = int(i * k);
+        shuffle(starts.begin(), starts.end(), rng);
+        starts.resize(n / 10 / k);
+        string label = "runs of " + to_string(k) + ", ";
+
+        Clock::time_point start;
+        {
+            Tree t(base);
+            start = Clock::now();
+            for (size_t i = 0; i < starts.size(); i++) {
+                for (int key = starts[i]; key < starts[i] + int(k); key++) treeRemove(t, key);
+            }
+            report("erase", name, (label + "remove loop").c_str(), elapsedNs(start) / (starts.size() * k), "ns/item");
+        }
+        {
+            Tree t(base);
+            start = Clock::now();
+            for (size_t i = 0; i < starts.size(); i++) {
+                t.erase(t.lower_bound(starts[i]), t.lower_bound(starts[i] + int(k)));
+            }
+            report("erase", name, (label + "erase(first, last)").c_str(), elapsedNs(start) / (starts.size() * k), "ns/item");
+        }
+    }
+
+    Clock::time_point start;
+    {
+        Tree t(base);
+        start = Clock::now();
+        for (typename Tree::iterator it = t.begin(); it != t.end(); ) {
+            int key = it->first;
+            ++it;
+            treeRemove(t, key);
+            if (it != t.end()) ++it;
+        }
+        report("erase", name, "every other item, remove(key)", elapsedNs(start) / (n - n / 2), "ns/item");
+    }
+    {
+        Tree t(base);
+        start = Clock::now();
+        for (typename Tree::iterator it = t.begin(); it != t.end(); ) {
+            it = t.erase(it);
+            if (it != t.end()) ++it;
+        }
+        report("erase", name, "every other item, erase(iterator)", elapsedNs(start) / (n - n / 2), "ns/item");
+    }
+}
+
+/**
+ * Delete-only: empties copies of a tree of n random keys, removing the
+ * keys in random order. Repeats until about 4M keys have been removed,
+ * so small trees, which stay in cache, time the removal itself rather
+ * than the descent to it.
+ */
+template<typename Tree>
+void benchDrain(const char* name, size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    Tree base;
+    for (size_t i = 0; i < n; i++) treeInsert(base, keys[i], i);
+    mt19937 rng(2);
+    shuffle(keys.begin(), keys.end(), rng);
+
+    size_t rounds = std::max(size_t(1), size_t(4000000) / std::max(n, size_t(1)));
+    double ns = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        Tree t(base);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++) treeRemove(t, keys[i]);
+        ns += elapsedNs(start);
+        if (!t.empty()) cerr << "drain: keys left over" << endl;
+    }
+    report("drain", name, ("remove all of " + to_string(n)).c_str(), ns / (rounds * n), "ns/op");
+}
+
+// lookup time per probe, in ns; found counts the hits
+template<typename Tree>
+double timeFinds(Tree& t, const vector<int>& probes, size_t& found)
+{
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++) {
+        if (t.find(probes[i]) != t.end()) found++;
+    }
+    return elapsedNs(start) / probes.size();
+}
+
+/**
+ * Skewed lookups on trees of n random keys: uniform probes, then Zipf
+ * traces with s from 0.8 to 1.2, against an AVLTree and SplayTrees that
+ * splay fully, semi-splay, and splay on every 8th access.
+ */
+void benchSplay(size_t n)
+{
+    typedef SplayTree<int, int, less<int>, SplayOptions<true> > SemiSplayTree;
+    typedef SplayTree<int, int, less<int>, SplayOptions<false, 8> > PeriodicSplayTree;
+    vector<int> keys = randomKeys(n, 1);
+    AVLTree<int, int> avl;
+    SplayTree<int, int> splay;
+    SemiSplayTree semi;
+    PeriodicSplayTree periodic;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(avl, keys[i], i);
+        treeInsert(splay, keys[i], i);
+        treeInsert(semi, keys[i], i);
+        treeInsert(periodic, keys[i], i);
+    }
+
+    size_t lookups = std::max(n, size_t(4000000));
+    const double skews[] = { 0, 0.8, 1.0, 1.2 };
+    for (size_t k = 0; k < 4; k++) {
+        vector<int> probes;
+        string what = "uniform";
+        if (skews[k] == 0) {
+            mt19937 rng(3);
+            for (size_t i = 0; i < lookups; i++) probes.push_back(keys[rng() % n]);
+        }
+        else {
+            probes = zipfProbes(keys, lookups, skews[k], 3);
+            what = "zipf " + to_string(skews[k]).substr(0, 3);
+        }
+        size_t found = 0;
+        report("splay", "avl", what.c_str(), timeFinds(avl, probes, found), "ns/op");
+        report("splay", "splay", what.c_str(), timeFinds(splay, probes, found), "ns/op");
+        report("splay", "splay-semi", what.c_str(), timeFinds(semi, probes, found), "ns/op");
+        report("splay", "splay-every-8", what.c_str(), timeFinds(periodic, probes, found), "ns/op");
+        if (found != 4 * lookups) cerr << "splay: lost keys" << endl;
+    }
+}
+
+/**
+ * The one-big-lock way to share an AVLTree, as the baseline for
+ * ConcurrentAVLTree.
+ */
+class LockedAVLTree
+{
+public:
+    void insert(const pair<const int, int>& item)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.insert(item);
+    }
+    void remove(int key)
+    {
+        lock_guard<mutex> lock(lock_);
+        tree_.remove(key);
+    }
+    bool find(int key, int& value) const
+    {
+        lock_guard<mutex> lock(lock_);
+        AVLTree<int, int>::const_iterator it = tree_.find(key);
+        if (it == tree_.end()) return false;
+        value = it->second;
+        return true;
+    }
+private:
+    AVLTree<int, int> tree_;
+    mutable mutex lock_;
+};
+
+/**
+ * Read/write mixes on 1 to maxThreads threads over a tree of n random
+ * keys, half of the probed keys present. Writes are half inserts, half
+ * removes, so the size stays put. Reports total throughput; every run
+ * does the same 2M operations split across its threads.
+ */
+template<typename Tree>
+void benchConcurrent(const char* name, size_t n, unsigned maxThreads)
+{
+    const size_t OPS = 2000000;
+    const unsigned readPercents[] = { 100, 90, 50 };
+    vector<int> keys = randomKeys(2 * n, 1);
+    for (size_t m = 0; m < 3; m++) {
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+            Tree t;
+            for (size_t i = 0; i < n; i++) t.insert(make_pair(keys[2 * i], int(i)));
+
+            vector<thread> workers;
+            vector<long long> found(threads, 0);
+            Clock::time_point start = Clock::now();
+            for (unsigned id = 0; id < threads; id++) {
+                workers.push_back(thread([&, id]() {
+                    mt19937 rng(id + 7);
+                    int value = 0;
+                    for (size_t i = 0; i < OPS / threads; i++) {
+                        unsigned r = rng();
+                        int key = keys[r % keys.size()];
+                        if ((r >> 24) % 100 < readPercents[m]) found[id] += t.find(key, value);
+                        else if (r & (1 << 23)) t.insert(make_pair(key, int(i)));
+                        else t.remove(key);
+                    }
+                }));
+            }
+            for (unsigned id = 0; id < threads; id++) workers[id].join();
+            double seconds = elapsedNs(start) / 1e9;
+
+            long long hits = 0;
+            for (unsigned id = 0; id < threads; id++) hits += found[id];
+            if (readPercents[m] == 100 && hits < (long long)(OPS / threads * threads / 3)) {
+                cerr << "concurrent: lost keys" << endl;
+            }
+            string what = to_string(readPercents[m]) + "% reads, " + to_string(threads)
+                + (threads == 1 ? " thread" : " threads");
+            report("concurrent", name, what.c_str(), OPS / seconds / 1e6, "Mops/s");
+        }
+    }
+}
+
+/**
+ * Consistent views of a changing tree: copying an AVLTree (what a reader
+ * needs today) against PersistentAVLTree::snapshot(), then the price of
+ * path copying: n / 10 random updates with no snapshot alive, and with a
+ * fresh snapshot held across every 1000 updates.
+ */
+void benchSnapshot(size_t n)
+{
+    typedef PersistentAVLTree<int, int> Persistent;
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> updates = randomKeys(n / 10, 2);
+    AVLTree<int, int> avl;
+    Persistent persistent;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(avl, keys[i], i);
+        persistent.insert(make_pair(keys[i], int(i)));
+    }
+    string size = to_string(n);
+
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<int, int> copy(avl);
+        report("snapshot", size.c_str(), "AVLTree copy", elapsedNs(start) / 1e6, "ms");
+    }
+    const int SNAPSHOTS = 1000;
+    start = Clock::now();
+    for (int i = 0; i < SNAPSHOTS; i++) {
+        Persistent view = persistent.snapshot();
+        if (view.size() != persistent.size()) cerr << "snapshot: wrong size" << endl;
+    }
+    report("snapshot", size.c_str(), "snapshot()", elapsedNs(start) / SNAPSHOTS, "ns");
+
+    start = Clock::now();
+    for (size_t i = 0; i < updates.size(); i++) treeInsert(avl, updates[i], i);
+    report("snapshot", size.c_str(), "AVLTree updates", elapsedNs(start) / updates.size(), "ns/update");
+    start = Clock::now();
+    for (size_t i = 0; i < updates.size(); i++) persistent.insert(make_pair(updates[i], int(i)));
+    report("snapshot", size.c_str(), "updates, no snapshot", elapsedNs(start) / updates.size(), "ns/update");
+    {
+        Persistent view;
+        start = Clock::now();
+        for (size_t i = 0; i < updates.size(); i++) {
+            if (i % 1000 == 0) view = persistent.snapshot();
+            persistent.insert(make_pair(updates[i], int(i) + 1));
+        }
+        report("snapshot", size.c_str(), "updates, snapshot per 1000", elapsedNs(start) / updates.size(), "ns/update");
+    }
+}
+
+/**
+ * Exposes the node-walking lookup that find() is built on.
+ */
+struct ProbeTree : public AVLTree<int, int>
+{
+    using AVLTree<int, int>::internalFind;
+};
+
+/**
+ * Lookups in an AVLTree through internalFind, against the frozen copy
+ * from freeze() and a binary search over its sorted item array. Half the
+ * probes hit. The footprint column says which cache level the tree
+ * outgrows.
+ */
+void benchFrozen(size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> probes = randomKeys(n, 3);
+    mt19937 rng(4);
+    for (size_t i = 0; i < n; i += 2) {
+        probes[i] = keys[rng() % n];
+    }
+    ProbeTree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+    string size = to_string(n);
+    Clock::time_point start = Clock::now();
+    FrozenTree<int, int> frozen = t.freeze();
+    report("frozen", size.c_str(), "freeze()", elapsedNs(start) / 1e6, "ms");
+    report("frozen", size.c_str(), "AVLTree footprint", t.bytesReserved() / 1048576.0, "MiB");
+    report("frozen", size.c_str(), "frozen footprint", frozen.bytesReserved() / 1048576.0, "MiB");
+
+    size_t lookups = std::max(n, size_t(4000000));
+    size_t found = 0, frozenFound = 0, arrayFound = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (t.internalFind(probes[i % n]) != NULL) found++;
+    }
+    report("frozen", size.c_str(), "internalFind", elapsedNs(start) / lookups, "ns/op");
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (frozen.find(probes[i % n]) != frozen.end()) frozenFound++;
+    }
+    report("frozen", size.c_str(), "FrozenTree::find", elapsedNs(start) / lookups, "ns/op");
+    start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        int key = probes[i % n];
+        FrozenTree<int, int>::const_iterator it = std::lower_bound(frozen.begin(), frozen.end(), key,
+            [](const pair<const int, int>& item, int k) { return item.first < k; });
+        if (it != frozen.end() && it->first == key) arrayFound++;
+    }
+    report("frozen", size.c_str(), "sorted array", elapsedNs(start) / lookups, "ns/op");
+    if (found < lookups / 2 || frozenFound != found || arrayFound != found) cerr << "frozen: lost keys" << endl;
+}
+
+/**
+ * Runs benchFrozen from about a quarter of L2 up to ten times the last
+ * level cache, sized by the AVLTree's footprint, unless n was given.
+ */
+void benchFrozenSweep()
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (l2 <= 0) l2 = 1 << 20;
+    if (llc <= 0) llc = 32 << 20;
+    const size_t bytesPerNode = sizeof(AVLNode<int, int>);
+    for (size_t n = std::max<size_t>(l2 / 4 / bytesPerNode, 1024);
+         n * bytesPerNode <= size_t(llc) * 10; n *= 4) {
+        benchFrozen(n);
+    }
+}
+
+/**
+ * Runs find over the probes, cycling through them lookups times, and
+ * reports millions of lookups per second.
+ */
+template<typename Find>
+size_t timeLookups(const char* stream, const char* name, const vector<int>& probes, size_t lookups, Find find)
+{
+    size_t found = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        if (find(probes[i % probes.size()])) found++;
+    }
+    report("eytzinger", stream, name, lookups / elapsedNs(start) * 1000.0, "Mlookups/s");
+    return found;
+}
+
+/**
+ * Lookups through AVLTree::internalFind against an EytzingerIndex built
+ * from the same tree, with and without AVX2, on a uniform stream (half
+ * hits) and a Zipf(0.99) stream of hits.
+ */
+void benchEytzinger(size_t n)
+{
+    vector<int> keys = randomKeys(n, 1);
+    vector<int> uniform = randomKeys(n, 3);
+    mt19937 rng(4);
+    for (size_t i = 0; i < n; i += 2) {
+        uniform[i] = keys[rng() % n];
+    }
+    size_t lookups = std::max(n, size_t(4000000));
+    vector<int> zipf = zipfProbes(keys, std::min(lookups, size_t(4000000)), 0.99, 5);
+
+    ProbeTree t;
+    for (size_t i = 0; i < n; i++) {
+        treeInsert(t, keys[i], i);
+    }
+    EytzingerIndex<int, int> index(t.cbegin(), t.cend());
+    EytzingerIndex<int, int> scalar(index);
+    scalar.disableSimd();
+    if (!index.simd()) cout << "eytzinger\t(no AVX2 on this CPU; both index rows are scalar)" << endl;
+
+    const char* streams[] = { "uniform", "zipf-0.99" };
+    const vector<int>* probes[] = { &uniform, &zipf };
+    for (int s = 0; s < 2; s++) {
+        size_t tree = timeLookups(streams[s], "internalFind", *probes[s], lookups,
+            [&t](int key) { return t.internalFind(key) != NULL; });
+        size_t simd = timeLookups(streams[s], "index, AVX2", *probes[s], lookups,
+            [&index](int key) { return index.find(key) != index.end(); });
+        size_t plain = timeLookups(streams[s], "index, scalar", *probes[s], lookups,
+            [&scalar](int key) { return scalar.find(key) != scalar.end(); });
+        if (simd != tree || plain != tree) cerr << "eytzinger: lookups disagree" << endl;
+    }
+}
+
+int usage()
+{
+    cerr << "usage: bst-bench <benchmark> <tree> [n]" << endl;
+    cerr << "  alloc   bst|avl|map   insert/churn/clear latency and RSS" << endl;
+    cerr << "  find    bst|avl|map   lookup throughput, half hits" << endl;
+    cerr << "          (alloc and find also take avl-os, the order-statistic AVLTree, and rb, the RBTree)" << endl;
+    cerr << "          (alloc, find, scan and copy also take btree and btree-4k, BTreeMap" << endl;
+    cerr << "          with 256-byte and 4 KiB nodes; strfind takes btree)" << endl;
+    cerr << "  mix     bst|avl|rb|map   insert-, delete- and lookup-heavy update mixes" << endl;
+    cerr << "  drain   bst|avl|rb|map   remove every key in random order, repeated on copies of small trees" << endl;
+    cerr << "  erase   bst|avl|rb|map   runs of keys: remove() loops vs erase(first, last); erase(iterator) in a scan" << endl;
+    cerr << "  findmany bst|avl      batches of 32-512 lookups: find() loop vs find_many()" << endl;
+    cerr << "  strfind bst|avl|map   lookup latency with long string keys" << endl;
+    cerr << "  memory  bst|avl       bytes/entry and cache misses per lookup" << endl;
+    cerr << "  load    <threads>     AVLTree insert loop vs assign_sorted/assign" << endl;
+    cerr << "  range   avl           range() and rbegin() queries vs linear walks" << endl;
+    cerr << "  scan    avl|avl-threaded|map|vector   full in-order scans" << endl;
+    cerr << "  copy    bst|avl|map   copy constructor vs re-inserting every item" << endl;
+    cerr << "  setops  avl           unite/intersect/subtract on 1-32 threads vs loops" << endl;
+    cerr << "  batch   avl           insert_batch/erase_batch vs insert/remove loops" << endl;
+    cerr << "  ingest  avl           mostly ascending timestamps: insert vs hinted insert, find vs find(hint)" << endl;
+    cerr << "  frozen  avl           internalFind vs freeze()d lookups, L2 to 10x LLC unless n is given" << endl;
+    cerr << "  splay   avl           AVLTree vs SplayTree (full, semi, every 8th) on uniform and Zipf 0.8-1.2 lookups" << endl;
+    cerr << "  eytzinger avl         internalFind vs EytzingerIndex (AVX2 and scalar), uniform and Zipf probes" << endl;
+    cerr << "  snapshot avl          AVLTree copies vs PersistentAVLTree snapshots and updates" << endl;
+    cerr << "  concurrent locked|concurrent [threads] [n]   read/write mixes on 1 to threads threads" << endl;
+    cerr << "          (locked is an AVLTree behind one mutex; threads defaults to the core count)" << endl;
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) return usage();
+    string bench = argv[1];
+    string tree = argv[2];
+    size_t n = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+
+    if (bench == "alloc") {
+        if (tree == "bst") benchAlloc<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchAlloc<AVLTree<int, int> >("avl", n);
+        else if (tree == "avl-os") benchAlloc<AVLTree<int, int, less<int>, AVLOptions<true> > >("avl-os", n);
+        else if (tree == "rb") benchAlloc<RBTree<int, int> >("rb", n);
+        else if (tree == "map") benchAlloc<map<int, int> >("map", n);
+        else if (tree == "btree") benchAlloc<BTree>("btree", n);
+        else if (tree == "btree-4k") benchAlloc<PageBTree>("btree-4k", n);
+        else return usage();
+    }
+    else if (bench == "find") {
+        if (tree == "bst") benchFind<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchFind<AVLTree<int, int> >("avl", n);
+        else if (tree == "avl-os") benchFind<AVLTree<int, int, less<int>, AVLOptions<true> > >("avl-os", n);
+        else if (tree == "rb") benchFind<RBTree<int, int> >("rb", n);
+        else if (tree == "map") benchFind<map<int, int> >("map", n);
+        else if (tree == "btree") benchFind<BTree>("btree", n);
+        else if (tree == "btree-4k") benchFind<PageBTree>("btree-4k", n);
+        else return usage();
+    }
+    else if (bench == "findmany") {
+        if (tree == "bst") benchFindMany<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchFindMany<AVLTree<int, int> >("avl", n);
+        else return usage();
+    }
+    else if (bench == "strfind") {
+        if (tree == "bst") benchStringFind<BinarySearchTree<string, int> >("bst", n);
+        else if (tree == "avl") benchStringFind<AVLTree<string, int> >("avl", n);
+        else if (tree == "map") benchStringFind<map<string, int> >("map", n);
+        else if (tree == "btree") benchStringFind<BTreeMap<string, int> >("btree", n);
+        else return usage();
+    }
+    else if (bench == "memory") {
+        if (tree == "bst") benchMemory<BinarySearchTree<int, int>, Node<int, int> >("bst", n);
+        else if (tree == "avl") benchMemory<AVLTree<int, int>, AVLNode<int, int> >("avl", n);
+        else return usage();
+    }
+    else if (bench == "range") {
+        if (tree == "avl") benchRange(n);
+        else return usage();
+    }
+    else if (bench == "scan") {
+        if (tree == "avl") benchScan<AVLTree<int, int> >("avl", n);
+        else if (tree == "avl-threaded") benchScan<AVLTree<int, int, less<int>, AVLOptions<false, true> > >("avl-threaded", n);
+        else if (tree == "map") benchScan<map<int, int> >("map", n);
+        else if (tree == "btree") benchScan<BTree>("btree", n);
+        else if (tree == "btree-4k") benchScan<PageBTree>("btree-4k", n);
+        else if (tree == "vector") benchScanVector(n);
+        else return usage();
+    }
+    else if (bench == "copy") {
+        if (tree == "bst") benchCopy<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchCopy<AVLTree<int, int> >("avl", n);
+        else if (tree == "map") benchCopy<map<int, int> >("map", n);
+        else if (tree == "btree") benchCopy<BTree>("btree", n);
+        else if (tree == "btree-4k") benchCopy<PageBTree>("btree-4k", n);
+        else return usage();
+    }
+    else if (bench == "setops") {
+        if (tree == "avl") benchSetOps(n);
+        else return usage();
+    }
+    else if (bench == "batch") {
+        if (tree == "avl") benchBatch(n);
+        else return usage();
+    }
+    else if (bench == "mix") {
+        if (tree == "bst") benchMix<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchMix<AVLTree<int, int> >("avl", n);
+        else if (tree == "rb") benchMix<RBTree<int, int> >("rb", n);
+        else if (tree == "map") benchMix<map<int, int> >("map", n);
+        else return usage();
+    }
+    else if (bench == "drain") {
+        if (tree == "bst") benchDrain<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchDrain<AVLTree<int, int> >("avl", n);
+        else if (tree == "rb") benchDrain<RBTree<int, int> >("rb", n);
+        else if (tree == "map") benchDrain<map<int, int> >("map", n);
+        else return usage();
+    }
+    else if (bench == "erase") {
+        if (tree == "bst") benchErase<BinarySearchTree<int, int> >("bst", n);
+        else if (tree == "avl") benchErase<AVLTree<int, int> >("avl", n);
+        else if (tree == "rb") benchErase<RBTree<int, int> >("rb", n);
+        else if (tree == "map") benchErase<map<int, int> >("map", n);
+        else return usage();
+    }
+    else if (bench == "splay") {
+        if (tree == "avl") benchSplay(n);
+        else return usage();
+    }
+    else if (bench == "ingest") {
+        if (tree == "avl") benchIngest(n);
+        else return usage();
+    }
+    else if (bench == "concurrent") {
+        unsigned threads = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+        size_t size = argc > 4 ? strtoul(argv[4], NULL, 10) : 1000000;
+        if (threads == 0) threads = defaultThreadCount();
+        if (tree == "locked") benchConcurrent<LockedAVLTree>("locked", size, threads);
+        else if (tree == "concurrent") benchConcurrent<ConcurrentAVLTree<int, int> >("concurrent", size, threads);
+        else return usage();
+    }
+    else if (bench == "frozen") {
+        if (tree != "avl") return usage();
+        if (argc > 3) benchFrozen(n);
+        else benchFrozenSweep();
+    }
+    else if (bench == "eytzinger") {
+        if (tree == "avl") benchEytzinger(n);
+        else return usage();
+    }
+    else if (bench == "snapshot") {
+        if (tree == "avl") benchSnapshot(n);
+        else return usage();
+    }
+    else if (bench == "load") {
+        benchLoad(n, strtoul(tree.c_str(), NULL, 10));
+    }
+    else {
+        return usage();
+    }
+    return 0;
+}
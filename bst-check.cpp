@@ -0,0 +1,561 @@
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "concurrent_avlbst.h"
+
+using namespace std;
+
+/*
+ * Checked tests: each section runs a tree against std::map (or another
+ * reference) and counts every mismatch. bst-check exits non-zero if any
+ * check failed, so `make check` catches regressions that bst-test, which
+ * only prints, would not.
+ * Usage: bst-check [section]   (default: all sections)
+ */
+
+int failures = 0;
+
+void check(bool ok, const string& what)
+{
+    if (!ok) {
+        if (failures < 20) cerr << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+/**
+ * An AVLTree that can check its own structure: parent links, balances,
+ * subtree sizes (when kept), both iteration orders (the thread links,
+ * when threaded) and the items themselves against a std::map.
+ */
+template<typename Options>
+class CheckedAVLTree : public AVLTree<int, string, less<int>, Options>
+{
+public:
+    typedef AVLTree<int, string, less<int>, Options> Base;
+
+    bool matches(const map<int, string>& want)
+    {
+        size_t count = 0;
+        bool ok = true;
+        shape(static_cast<AVLNode<int, string>*>(this->root_), nullptr, count, ok);
+        ok = ok && count == want.size() && equal(this->begin(), this->end(), want.begin());
+        typename map<int, string>::const_reverse_iterator w = want.rbegin();
+        for (typename Base::reverse_iterator it = this->rbegin(); ok && it != this->rend(); ++it, ++w) {
+            ok = it->first == w->first;
+        }
+        return ok;
+    }
+
+private:
+    typedef typename Base::TreeNode TreeNode;
+
+    int shape(AVLNode<int, string>* n, AVLNode<int, string>* parent, size_t& count, bool& ok)
+    {
+        if (n == nullptr) {
+            count = 0;
+            return 0;
+        }
+        size_t leftCount, rightCount;
+        int leftHeight = shape(n->getLeft(), n, leftCount, ok);
+        int rightHeight = shape(n->getRight(), n, rightCount, ok);
+        count = leftCount + rightCount + 1;
+        ok = ok && n->getParent() == parent && n->getBalance() == leftHeight - rightHeight
+            && sizeOk(n, count, integral_constant<bool, Options::orderStatistics>());
+        return max(leftHeight, rightHeight) + 1;
+    }
+    static bool sizeOk(AVLNode<int, string>* n, size_t count, true_type)
+    {
+        return static_cast<TreeNode*>(n)->getSize() == count;
+    }
+    static bool sizeOk(AVLNode<int, string>*, size_t, false_type) { return true; }
+};
+
+mt19937 rng(11);
+
+template<typename Tree>
+void fill(Tree& t, map<int, string>& m, int n, int range, const string& tag)
+{
+    for (int i = 0; i < n; i++) {
+        int key = rng() % range;
+        string value = tag + to_string(i);
+        t.insert(make_pair(key, value));
+        m[key] = value;
+    }
+}
+
+/**
+ * unite/intersect/subtract/join on random pairs of trees, small and
+ * large, overlapping or not, on 1 to 8 threads, for one AVLOptions.
+ */
+template<typename Options>
+void checkSetOps(const string& name)
+{
+    typedef CheckedAVLTree<Options> Tree;
+    for (int round = 0; round < 300; round++) {
+        int range = 1 + rng() % 3000;
+        int na = rng() % (round % 5 == 0 ? 3000 : 60);
+        int nb = rng() % (round % 7 == 0 ? 3000 : 60);
+        unsigned threads = 1 + rng() % 8;
+        string label = name + " round " + to_string(round) + ", ";
+
+        for (int op = 0; op < 4; op++) {
+            Tree a, b;
+            map<int, string> ma, mb, want;
+            fill(a, ma, na, range, "a");
+            fill(b, mb, nb, range, "b");
+            if (op == 0) {
+                want = ma;
+                want.insert(mb.begin(), mb.end());
+                a.unite(b, threads);
+            }
+            else if (op == 1) {
+                for (map<int, string>::iterator it = ma.begin(); it != ma.end(); ++it) {
+                    if (mb.count(it->first)) want.insert(*it);
+                }
+                a.intersect(b, threads);
+            }
+            else if (op == 2) {
+                for (map<int, string>::iterator it = ma.begin(); it != ma.end(); ++it) {
+                    if (!mb.count(it->first)) want.insert(*it);
+                }
+                a.subtract(b, threads);
+            }
+            else {
+                // join a tree whose keys all follow a's
+                Tree c;
+                map<int, string> mc;
+                int base = ma.empty() ? 0 : ma.rbegin()->first + 1;
+                for (int i = 0; i < nb; i++) {
+                    int key = base + rng() % range;
+                    c.insert(make_pair(key, string("c")));
+                    mc[key] = "c";
+                }
+                want = ma;
+                want.insert(mc.begin(), mc.end());
+                a.join(c);
+                check(c.empty(), label + "join leaves the right tree empty");
+                b.clear();
+            }
+            const char* what[] = { "unite", "intersect", "subtract", "join" };
+            check(b.empty(), label + what[op] + " leaves the other tree empty");
+            check(a.matches(want), label + what[op]);
+
+            // both trees stay usable, and a reuses the memory it took over
+            for (int i = 0; i < 50; i++) {
+                int key = rng() % range;
+                a.insert(make_pair(key, string("z")));
+                want[key] = "z";
+                key = rng() % range;
+                a.remove(key);
+                want.erase(key);
+            }
+            check(a.matches(want), label + what[op] + ", then updates");
+            b.insert(make_pair(1, string("y")));
+            check(b.begin()->first == 1, label + what[op] + ", other tree reused");
+        }
+    }
+
+    // a key out of order makes join throw and change nothing
+    Tree a, b;
+    map<int, string> ma;
+    fill(a, ma, 100, 1000, "a");
+    b.insert(make_pair(ma.begin()->first, string("x")));
+    bool threw = false;
+    try {
+        a.join(b);
+    }
+    catch (invalid_argument&) {
+        threw = true;
+    }
+    check(threw && a.matches(ma) && !b.empty(), name + " join out of order");
+
+    // the right tree's freed nodes come along with its pool
+    Tree left, right;
+    map<int, string> want;
+    fill(left, want, 100, 100, "l");
+    for (int i = 0; i < 10000; i++) right.insert(make_pair(1000 + i, string("r")));
+    for (int i = 0; i < 10000; i++) right.remove(1000 + i);
+    right.insert(make_pair(500, string("r")));
+    want[500] = "r";
+    left.join(right);
+    fill(left, want, 20000, 100000, "n");
+    check(left.matches(want), name + " join after frees, then inserts");
+}
+
+void checkSetOps()
+{
+    checkSetOps<AVLOptions<> >("setops");
+    checkSetOps<AVLOptions<true> >("setops order-statistics");
+    checkSetOps<AVLOptions<false, true> >("setops threaded");
+    checkSetOps<AVLOptions<true, true> >("setops order-statistics threaded");
+
+    // large trees, so the recursion really forks
+    for (unsigned threads = 1; threads <= 8; threads *= 2) {
+        typedef CheckedAVLTree<AVLOptions<true> > Tree;
+        Tree a, b, c;
+        map<int, string> ma, mb, mc;
+        fill(a, ma, 100000, 200000, "a");
+        fill(b, mb, 100000, 200000, "b");
+        fill(c, mc, 50000, 200000, "c");
+        Tree c2(c);
+        string label = "setops large, " + to_string(threads) + " threads, ";
+
+        map<int, string> want = ma;
+        want.insert(mb.begin(), mb.end());
+        a.unite(b, threads);
+        check(a.matches(want), label + "unite");
+        map<int, string> both;
+        for (map<int, string>::iterator it = want.begin(); it != want.end(); ++it) {
+            if (mc.count(it->first)) both.insert(*it);
+        }
+        a.intersect(c, threads);
+        check(a.matches(both), label + "intersect");
+        a.subtract(c2, threads);
+        check(a.empty() && a.size() == 0, label + "subtract");
+    }
+}
+
+/**
+ * ConcurrentAVLTree under several threads. First each thread writes
+ * only keys of its own residue class and keeps its own std::map, so
+ * every thread can check its own reads exactly while all threads also
+ * read each other's keys; then all threads fight over a small range.
+ * Threads count their own mismatches; check() runs only once they are
+ * joined. Build with -fsanitize=thread (make check-tsan) to catch races.
+ */
+void checkConcurrent()
+{
+    const int threads = 4, ops = 50000, range = 2000;
+    ConcurrentAVLTree<int, string> t;
+    vector<map<int, string> > oracles(threads);
+    vector<int> bad(threads, 0);
+    vector<std::thread> workers;
+
+    for (int id = 0; id < threads; id++) {
+        workers.push_back(std::thread([&, id]() {
+            mt19937 local(id + 1);
+            map<int, string>& mine = oracles[id];
+            for (int i = 0; i < ops; i++) {
+                int key = (local() % range) * threads + id;
+                unsigned roll = local() % 10;
+                string value;
+                if (roll < 3) {
+                    value = to_string(key) + ":" + to_string(i);
+                    t.insert(make_pair(key, value));
+                    mine[key] = value;
+                }
+                else if (roll < 5) {
+                    t.remove(key);
+                    mine.erase(key);
+                }
+                else if (roll < 7) {
+                    bool found = t.find(key, value);
+                    map<int, string>::iterator it = mine.find(key);
+                    if (found != (it != mine.end()) || (found && value != it->second)) bad[id]++;
+                }
+                else {
+                    // another thread's key: any value seen must belong to it
+                    int other = local() % (range * threads);
+                    string prefix = to_string(other) + ":";
+                    if (t.find(other, value) && value.compare(0, prefix.size(), prefix) != 0) bad[id]++;
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+
+    size_t total = 0;
+    for (int id = 0; id < threads; id++) {
+        check(bad[id] == 0, "concurrent, thread " + to_string(id) + " read a wrong value");
+        total += oracles[id].size();
+        for (map<int, string>::iterator it = oracles[id].begin(); it != oracles[id].end(); ++it) {
+            string value;
+            check(t.find(it->first, value) && value == it->second, "concurrent, final value of " + to_string(it->first));
+        }
+    }
+    check(t.size() == total && t.isBalanced(), "concurrent, size and balance after disjoint writers");
+
+    // every thread on the same 64 keys
+    const int hot = range * threads;
+    for (int id = 0; id < threads; id++) {
+        bad[id] = 0;
+        workers.push_back(std::thread([&, id]() {
+            mt19937 local(100 + id);
+            for (int i = 0; i < ops; i++) {
+                int key = hot + local() % 64;
+                unsigned roll = local() % 3;
+                string value;
+                if (roll == 0) t.insert(make_pair(key, to_string(key) + ":x"));
+                else if (roll == 1) t.remove(key);
+                else if (t.find(key, value) && value != to_string(key) + ":x") bad[id]++;
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    for (int id = 0; id < threads; id++) {
+        check(bad[id] == 0, "concurrent, thread " + to_string(id) + " read a wrong hot value");
+    }
+    check(t.isBalanced(), "concurrent, balance after contended writers");
+
+    for (int key = hot; key < hot + 64; key++) t.remove(key);
+    for (int id = 0; id < threads; id++) {
+        for (map<int, string>::iterator it = oracles[id].begin(); it != oracles[id].end(); ++it) t.remove(it->first);
+    }
+    check(t.empty() && t.size() == 0 && t.isBalanced(), "concurrent, empty after removing everything");
+    bool threw = false;
+    try {
+        t[5];
+    }
+    catch (out_of_range&) {
+        threw = true;
+    }
+    check(threw, "concurrent, operator[] on a missing key throws");
+}
+
+/**
+ * remove() against the removal it replaced, which nodeSwap'ed a node
+ * with two children down to its predecessor's place before unlinking
+ * it. SwapRemove<Tree, NodeType> keeps that old path as swapRemove() and
+ * prints its shape, so two trees fed the same keys can be compared after
+ * every step.
+ */
+template<typename Tree, typename NodeType>
+class SwapRemove : public Tree
+{
+public:
+    string layout() const
+    {
+        string s;
+        layout(static_cast<NodeType*>(this->root_), s);
+        return s;
+    }
+
+    void swapRemove(int key)
+    {
+        NodeType* node = static_cast<NodeType*>(this->internalFind(key));
+        if (node != nullptr) removeOld(node);
+    }
+
+protected:
+    // the nodeSwap-then-unlink removal, per tree
+    void removeOld(NodeType* node);
+
+    // unlinks node, which has at most one child, and returns its parent
+    NodeType* unlink(NodeType* node, bool& wasLeft)
+    {
+        NodeType* parent = node->getParent();
+        NodeType* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+        if (child != nullptr) {
+            child->setParent(parent);
+        }
+        wasLeft = parent != nullptr && parent->getLeft() == node;
+        if (parent == nullptr) {
+            this->root_ = child;
+        }
+        else if (wasLeft) {
+            parent->setLeft(child);
+        }
+        else {
+            parent->setRight(child);
+        }
+        if (node == this->largest_) {
+            this->largest_ = nullptr;
+        }
+        return parent;
+    }
+
+    static void layout(NodeType* n, string& s)
+    {
+        if (n == nullptr) {
+            s += '.';
+            return;
+        }
+        s += '(';
+        layout(n->getLeft(), s);
+        s += ' ' + to_string(n->getKey()) + mark(n) + ' ';
+        layout(n->getRight(), s);
+        s += ')';
+    }
+    static string mark(Node<int, string>*) { return ""; }
+    static string mark(AVLNode<int, string>* n) { return ":" + to_string(int(n->getBalance())); }
+    static string mark(RBNode<int, string>* n) { return n->isRed() ? ":r" : ":b"; }
+};
+
+typedef SwapRemove<BinarySearchTree<int, string>, Node<int, string> > SwapRemoveBST;
+typedef SwapRemove<SplayTree<int, string>, Node<int, string> > SwapRemoveSplay;
+typedef SwapRemove<RBTree<int, string>, RBNode<int, string> > SwapRemoveRB;
+
+template<>
+void SwapRemoveBST::removeOld(Node<int, string>* node)
+{
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        this->nodeSwap(node, this->predecessor(node));
+    }
+    bool wasLeft;
+    unlink(node, wasLeft);
+    this->destroyNode(node);
+}
+
+template<>
+void SwapRemoveSplay::removeOld(Node<int, string>* node)
+{
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        this->nodeSwap(node, this->predecessor(node));
+    }
+    bool wasLeft;
+    Node<int, string>* parent = unlink(node, wasLeft);
+    this->destroyNode(node);
+    if (parent != nullptr) {
+        this->access(parent);
+    }
+}
+
+template<>
+void SwapRemoveRB::removeOld(RBNode<int, string>* node)
+{
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        // the colors stay with the positions
+        RBNode<int, string>* pred = static_cast<RBNode<int, string>*>(this->predecessor(node));
+        BinarySearchTree<int, string>::nodeSwap(node, pred);
+        bool red = node->isRed();
+        node->setRed(pred->isRed());
+        pred->setRed(red);
+    }
+    RBNode<int, string>* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+    bool wasLeft;
+    RBNode<int, string>* parent = unlink(node, wasLeft);
+    bool fix = !node->isRed();
+    this->destroyNode(node);
+    if (fix) {
+        this->removeFix(child, parent);
+    }
+}
+
+template<typename Options>
+class SwapRemoveAVL : public SwapRemove<CheckedAVLTree<Options>, AVLNode<int, string> >
+{
+public:
+    void swapRemove(int key)
+    {
+        AVLNode<int, string>* node = static_cast<AVLNode<int, string>*>(this->internalFind(key));
+        if (node == nullptr) return;
+        if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+            // AVLTree::nodeSwap also trades balances, sizes and threads
+            this->nodeSwap(node, static_cast<AVLNode<int, string>*>(this->predecessor(node)));
+        }
+        bool wasLeft;
+        AVLNode<int, string>* parent = this->unlink(node, wasLeft);
+        this->threadOut(node, typename CheckedAVLTree<Options>::KeepThreads());
+        this->destroyNode(node);
+        this->addToPathSizes(parent, size_t(-1), typename CheckedAVLTree<Options>::KeepSizes());
+        this->removeFix(parent, parent == nullptr ? 0 : wasLeft ? +1 : -1);
+    }
+};
+
+/**
+ * Fills two trees with the same keys, then removes keys in random order
+ * (some missing) with remove() from one and swapRemove() from the
+ * other: the shapes, balances and colors must agree after every step,
+ * and an iterator to another item must survive each removal.
+ */
+template<typename Tree>
+void checkRemove(const string& name, bool (*valid)(Tree&, const map<int, string>&))
+{
+    for (int round = 0; round < 200; round++) {
+        int n = rng() % (round % 20 == 0 ? 1000 : 100);
+        int range = 1 + 2 * n;
+        Tree now, old;
+        map<int, string> want;
+        for (int i = 0; i < n; i++) {
+            int key = rng() % range;
+            now.insert(make_pair(key, string("v")));
+            old.insert(make_pair(key, string("v")));
+            want[key] = "v";
+        }
+        check(now.layout() == old.layout(), name + " round " + to_string(round) + ", same shape before removing");
+
+        vector<int> keys;
+        for (int key = 0; key < range; key++) keys.push_back(key);
+        shuffle(keys.begin(), keys.end(), rng);
+        bool same = true, kept = true;
+        for (size_t i = 0; i < keys.size() && same && kept; i++) {
+            int key = keys[i];
+            int other = rng() % range;
+            typename Tree::iterator it = now.lower_bound(other);
+            bool watch = it != now.end() && it->first != key;
+            now.remove(key);
+            old.swapRemove(key);
+            want.erase(key);
+            same = now.layout() == old.layout() && valid(now, want);
+            if (watch) {
+                map<int, string>::iterator w = want.find(it->first);
+                kept = w != want.end() && it->second == w->second;
+                ++it;
+                ++w;
+                kept = kept && (it == now.end() ? w == want.end() : w != want.end() && it->first == w->first);
+            }
+        }
+        check(same, name + " round " + to_string(round) + ", remove() matches the old removal");
+        check(kept, name + " round " + to_string(round) + ", iterators to other items stay valid");
+    }
+}
+
+template<typename Tree>
+bool sameItems(Tree& t, const map<int, string>& want)
+{
+    return size_t(distance(t.begin(), t.end())) == want.size() && equal(t.begin(), t.end(), want.begin());
+}
+
+bool validRB(SwapRemoveRB& t, const map<int, string>& want)
+{
+    return t.isBalanced() && sameItems(t, want);
+}
+
+template<typename Options>
+bool validAVL(SwapRemoveAVL<Options>& t, const map<int, string>& want)
+{
+    return t.matches(want);
+}
+
+void checkRemove()
+{
+    checkRemove<SwapRemoveBST>("remove bst", sameItems<SwapRemoveBST>);
+    checkRemove<SwapRemoveSplay>("remove splay", sameItems<SwapRemoveSplay>);
+    checkRemove<SwapRemoveRB>("remove rb", validRB);
+    checkRemove<SwapRemoveAVL<AVLOptions<> > >("remove avl", validAVL<AVLOptions<> >);
+    checkRemove<SwapRemoveAVL<AVLOptions<true, true> > >("remove avl order-statistics threaded",
+        validAVL<AVLOptions<true, true> >);
+}
+
+int main(int argc, char* argv[])
+{
+    string section = argc > 1 ? argv[1] : "all";
+    bool any = false;
+    if (section == "all" || section == "setops") {
+        checkSetOps();
+        any = true;
+    }
+    if (section == "all" || section == "remove") {
+        checkRemove();
+        any = true;
+    }
+    if (section == "all" || section == "concurrent") {
+        checkConcurrent();
+        any = true;
+    }
+    if (!any) {
+        cerr << "usage: bst-check [all|setops|remove|concurrent]" << endl;
+        return 2;
+    }
+    cout << (failures == 0 ? "all checks passed" : to_string(failures) + " checks failed") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include "bst.h"
+#include "avlbst.h"
+
+using namespace std;
+
+/*
+ * Stress test for deep trees.
+ * Usage: bst-stress [n]   (default 50000000)
+ * Builds n-node degenerate (linked list shaped) trees, which is what a plain
+ * BinarySearchTree turns into when fed sorted keys, and times every
+ * operation that has to walk the whole depth, ending with the teardown.
+ */
+
+typedef chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+void report(const char* shape, const char* what, double ms)
+{
+    cout << "stress\t" << shape << "\t" << what << "\t" << ms << " ms" << endl;
+}
+
+// A value with a user-provided destructor, so clear() and the destructor
+// really have to visit every node instead of just dropping the pool.
+struct Payload {
+    Payload(int v) : value(v) {}
+    ~Payload() {}
+    int value;
+};
+
+/**
+ * Exposes a way to build a degenerate tree in O(n). Sorted insert() calls
+ * would produce the same shape, but take O(n^2) time to get there.
+ */
+class SpineTree : public BinarySearchTree<int, Payload>
+{
+public:
+    void buildSpine(int n, bool ascending)
+    {
+        Node<int, Payload>* tail = nullptr;
+        for (int i = 0; i < n; i++) {
+            int key = ascending ? i : n - 1 - i;
+            Node<int, Payload>* node = createNode(tail, key, Payload(key));
+            linkNode(tail, node, !ascending);
+            tail = node;
+        }
+    }
+};
+
+void stressSpine(int n, bool ascending)
+{
+    const char* shape = ascending ? "right-spine" : "left-spine";
+    int deepest = ascending ? n - 1 : 0;
+    Clock::time_point start;
+    {
+        SpineTree t;
+        start = Clock::now();
+        t.buildSpine(n, ascending);
+        report(shape, "build", elapsedMs(start));
+
+        start = Clock::now();
+        bool balanced = t.isBalanced();
+        report(shape, "isBalanced", elapsedMs(start));
+        if (balanced && n > 2) cerr << shape << ": reported as balanced" << endl;
+
+        start = Clock::now();
+        long long sum = 0;
+        for (BinarySearchTree<int, Payload>::iterator it = t.begin(); it != t.end(); ++it) {
+            sum += it->second.value;
+        }
+        report(shape, "iterate", elapsedMs(start));
+        if (sum != (long long)n * (n - 1) / 2) cerr << shape << ": iteration lost keys" << endl;
+
+        start = Clock::now();
+        {
+            SpineTree copy(t);
+            report(shape, "copy", elapsedMs(start));
+            if (copy.find(deepest) == copy.end()) cerr << shape << ": copy lost the deepest key" << endl;
+        }
+
+        start = Clock::now();
+        if (t.find(deepest) == t.end()) cerr << shape << ": deepest key missing" << endl;
+        t.remove(deepest);
+        report(shape, "find+remove deepest", elapsedMs(start));
+
+        start = Clock::now();
+        t.clear();
+        report(shape, "clear", elapsedMs(start));
+
+        // the destructor walks the same path as clear(), time it on a full tree
+        t.buildSpine(n, ascending);
+        start = Clock::now();
+    }
+    report(shape, "destructor", elapsedMs(start));
+}
+
+void stressAvl(int n)
+{
+    Clock::time_point start;
+    {
+        AVLTree<int, Payload> t;
+        // sorted input rebalances on nearly every insert and remove
+        start = Clock::now();
+        for (int i = 0; i < n; i++) {
+            t.insert(std::make_pair(i, Payload(i)));
+        }
+        report("avl", "sorted insert", elapsedMs(start));
+
+        start = Clock::now();
+        if (!t.isBalanced()) cerr << "avl: not balanced" << endl;
+        report("avl", "isBalanced", elapsedMs(start));
+
+        start = Clock::now();
+        for (int i = 0; i < n / 2; i++) {
+            t.remove(i);
+        }
+        report("avl", "sorted remove half", elapsedMs(start));
+        start = Clock::now();
+    }
+    report("avl", "destructor", elapsedMs(start));
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 50000000;
+    if (n <= 0) {
+        cerr << "usage: bst-stress [n]" << endl;
+        return 1;
+    }
+    stressSpine(n, true);
+    stressSpine(n, false);
+    stressAvl(n);
+    return 0;
+}
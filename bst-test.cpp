@@ -1,7 +1,15 @@
 #include <iostream>
 #include <map>
+#include <thread>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "concurrent_avlbst.h"
+#include "persistent_avlbst.h"
+#include "btree.h"
+#include "eytzinger_index.h"
 
 using namespace std;
 
@@ -44,5 +52,220 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // In-place construction: try_emplace never overwrites or builds a value for an existing key
+    AVLTree<string,string> st;
+    st.insert(std::make_pair(string("x"), string("first")));
+    st.emplace("y", "second");
+    if(!st.try_emplace("x", 3, 'z').second) {
+        cout << "\nx already present: " << st["x"] << endl;
+    }
+    st.insert(std::make_pair(string("x"), string("overwritten")));
+    cout << "x after insert: " << st["x"] << endl;
+
+    // Custom ordering: iterate from largest to smallest key
+    AVLTree<int,char,std::greater<int> > rt;
+    for(int i = 1; i <= 5; i++) {
+        rt.insert(std::make_pair(i, char('a' + i - 1)));
+    }
+    cout << "\nAVLTree with std::greater:";
+    for(AVLTree<int,char,std::greater<int> >::iterator it = rt.begin(); it != rt.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Range queries: the items with 2 <= key < 5, and the first key above 3
+    AVLTree<int,char> qt;
+    for(int i = 0; i < 8; i++) {
+        qt.insert(std::make_pair(i, char('a' + i)));
+    }
+    cout << "Keys in [2, 5):";
+    BinarySearchTree<int,char>::range_view r = qt.range(2, 5);
+    for(BinarySearchTree<int,char>::iterator it = r.begin(); it != r.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl << "upper_bound(3): " << qt.upper_bound(3)->first << endl;
+
+    // Several lookups at once; misses come back as end()
+    int wanted[] = { 6, 42, 1 };
+    std::vector<AVLTree<int,char>::iterator> hits(3);
+    qt.find_many(wanted, wanted + 3, hits.begin());
+    cout << "find_many:";
+    for(size_t i = 0; i < hits.size(); i++) {
+        cout << " " << (hits[i] == qt.end() ? '-' : hits[i]->second);
+    }
+    cout << endl;
+
+    // Hinted inserts for keys arriving mostly in order; 25 arrives late
+    AVLTree<int,int> ht;
+    AVLTree<int,int>::iterator hint = ht.end();
+    int arrivals[] = { 10, 20, 30, 40, 25, 50 };
+    for(int i = 0; i < 6; i++) {
+        hint = ht.insert(hint, std::make_pair(arrivals[i], i));
+    }
+    cout << "Hinted:";
+    for(AVLTree<int,int>::iterator it = ht.begin(); it != ht.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", find(hint, 25): " << ht.find(hint, 25)->second
+         << ", balanced: " << ht.isBalanced() << endl;
+
+    // Erasing through iterators: drop odd keys during a scan, then a whole range
+    AVLTree<int,int> et;
+    for(int i = 0; i < 20; i++) {
+        et.insert(std::make_pair(i, i));
+    }
+    for(AVLTree<int,int>::iterator it = et.begin(); it != et.end(); ) {
+        it = it->first % 2 ? et.erase(it) : ++it;
+    }
+    et.erase(et.lower_bound(4), et.lower_bound(14));
+    cout << "Erased:";
+    for(AVLTree<int,int>::iterator it = et.begin(); it != et.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", balanced: " << et.isBalanced() << endl;
+
+    // Order statistics: position of a key and the key at a position
+    AVLTree<int,char,std::less<int>,AVLOptions<true> > ot;
+    for(int i = 0; i < 10; i++) {
+        ot.insert(std::make_pair(i * 10, char('a' + i)));
+    }
+    cout << "size " << ot.size() << ", rank(35) " << ot.rank(35)
+         << ", median " << ot.select(ot.size() / 2)->first
+         << ", keys in [20, 60): " << ot.count_range(20, 60) << endl;
+
+    // Descending scan of the three largest keys, then back from end()
+    cout << "Largest three:";
+    int shown = 0;
+    for(AVLTree<int,char>::const_reverse_iterator it = qt.crbegin(); it != qt.crend() && shown < 3; ++it, ++shown) {
+        cout << " " << it->first;
+    }
+    AVLTree<int,char>::iterator last = qt.end();
+    --last;
+    cout << endl << "--end(): " << last->first << endl;
+
+    // Threaded mode: iterators follow in-order links, kept through removes
+    AVLTree<int,char,std::less<int>,AVLOptions<false,true> > tt;
+    for(int i = 9; i >= 0; i--) {
+        tt.insert(std::make_pair(i, char('a' + i)));
+    }
+    tt.remove(4);
+    tt.remove(7);
+    cout << "Threaded scan:";
+    for(AVLTree<int,char,std::less<int>,AVLOptions<false,true> >::iterator it = tt.begin(); it != tt.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
+    // Copies are independent; a move leaves the source empty
+    AVLTree<int,char,std::less<int>,AVLOptions<false,true> > copy(tt);
+    copy.remove(0);
+    AVLTree<int,char,std::less<int>,AVLOptions<false,true> > moved(std::move(tt));
+    cout << "Copy starts at " << copy.begin()->first << ", moved tree at " << moved.begin()->first
+         << ", source " << (tt.empty() ? "empty" : "not empty") << endl;
+
+    // Set operations take over the other tree's nodes
+    AVLTree<int,char> evens, threes, low;
+    for(int i = 0; i < 12; i++) {
+        if(i % 2 == 0) evens.insert(std::make_pair(i, 'e'));
+        if(i % 3 == 0) threes.insert(std::make_pair(i, 't'));
+    }
+    for(int i = 0; i < 4; i++) {
+        low.insert(std::make_pair(i, 'l'));
+    }
+    evens.unite(threes, 2);
+    evens.subtract(low);
+    cout << "(evens | threes) - [0, 4):";
+    for(AVLTree<int,char>::iterator it = evens.begin(); it != evens.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl;
+
+    // Batches arrive unsorted; insert_batch overwrites like insert()
+    std::pair<int,char> batch[] = { std::make_pair(20, 'b'), std::make_pair(6, 'b'), std::make_pair(15, 'b') };
+    int doomed[] = { 9, 20, 100 };
+    evens.insert_batch(batch, batch + 3);
+    evens.erase_batch(doomed, doomed + 3);
+    cout << "After batches:";
+    for(AVLTree<int,char>::iterator it = evens.begin(); it != evens.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl;
+
+    // An RBTree takes the same calls; isBalanced checks the red-black rules
+    RBTree<int,char> rb;
+    for(int i = 0; i < 20; i++) {
+        rb.insert(std::make_pair(i, char('a' + i)));
+    }
+    for(int i = 0; i < 20; i += 3) {
+        rb.remove(i);
+    }
+    cout << "RBTree: first " << rb.begin()->first << ", rb[10]: " << rb[10]
+         << ", last " << rb.rbegin()->first << ", balanced: " << rb.isBalanced() << endl;
+
+    // A SplayTree moves each key it finds or inserts up to the root
+    SplayTree<int,char> sp;
+    for(int i = 0; i < 10; i++) {
+        sp.insert(std::make_pair(i, char('a' + i)));
+    }
+    sp.find(4);
+    sp.remove(9);
+    SplayTree<int,char>::iterator sh = sp.insert(sp.end(), std::make_pair(12, 'm'));
+    sp.insert(sh, std::make_pair(11, 'l'));
+    cout << "SplayTree: sp[6]: " << sp[6] << ", begin " << sp.begin()->first
+         << ", has 9: " << (sp.find(9) != sp.end()) << ", last " << sp.rbegin()->first << endl;
+
+    // A ConcurrentAVLTree shared by two writers without any outside locking
+    ConcurrentAVLTree<int,int> ct;
+    std::thread odd([&ct]() { for(int i = 1; i < 1000; i += 2) ct.insert(std::make_pair(i, i)); });
+    for(int i = 0; i < 1000; i += 2) ct.insert(std::make_pair(i, i));
+    odd.join();
+    int value = 0;
+    ct.remove(500);
+    cout << "Concurrent tree: size " << ct.size() << ", has 500: " << ct.contains(500)
+         << ", find(999): " << (ct.find(999, value) ? value : -1)
+         << ", balanced: " << ct.isBalanced() << endl;
+
+    // Snapshots of a PersistentAVLTree keep their contents while the tree changes
+    PersistentAVLTree<int,char> pt;
+    for(int i = 0; i < 5; i++) {
+        pt.insert(std::make_pair(i, char('a' + i)));
+    }
+    PersistentAVLTree<int,char> before = pt.snapshot();
+    pt.remove(2);
+    pt.insert(std::make_pair(0, 'z'));
+    cout << "Snapshot:";
+    for(PersistentAVLTree<int,char>::iterator it = before.begin(); it != before.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl << "Current:";
+    for(PersistentAVLTree<int,char>::iterator it = pt.begin(); it != pt.end(); ++it) {
+        cout << " " << it->first << it->second;
+    }
+    cout << endl;
+
+    // A frozen copy answers the same lookups without any pointers
+    FrozenTree<int,char> ft = qt.freeze();
+    qt.remove(3);
+    cout << "Frozen: size " << ft.size() << ", find(3): " << ft.find(3)->second
+         << ", lower_bound(8): " << (ft.lower_bound(8) == ft.end() ? "end" : "item")
+         << ", largest: " << ft.rbegin()->first << endl;
+
+    // BTreeMap takes the same calls; small nodes here so it grows a few levels
+    BTreeMap<int,int,std::less<int>,64> bm;
+    for(int i = 0; i < 100; i++) {
+        bm.insert(std::make_pair(i, i * i));
+    }
+    for(int i = 0; i < 100; i += 3) {
+        bm.remove(i);
+    }
+    cout << "BTreeMap: size " << bm.size() << ", bm[10] " << bm[10]
+         << ", first " << bm.begin()->first << ", last " << bm.rbegin()->first
+         << ", balanced: " << bm.isBalanced() << endl;
+
+    // An EytzingerIndex over qt, which no longer holds 3
+    EytzingerIndex<int,char> ei(qt.cbegin(), qt.cend());
+    cout << "Index: size " << ei.size() << ", lower_bound(3): " << ei.lower_bound(3)->first
+         << ", [6]: " << ei[6] << ", has 3: " << (ei.find(3) != ei.end()) << endl;
+
     return 0;
 }
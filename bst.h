@@ -3,22 +3,58 @@
 
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
 #include <utility>
+#include <tuple>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <cstddef>
+#include <string>
+#include "node_pool.h"
+#include "frozen_bst.h"
+
+// Keeps a rarely taken path out of line, so that the small hot functions
+// calling it (iterator steps) stay cheap enough to be inlined.
+#if defined(__GNUC__)
+#define BST_NOINLINE __attribute__((noinline))
+#else
+#define BST_NOINLINE
+#endif
+
+// Starts loading a node that a lookup will visit next.
+#if defined(__GNUC__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BST_PREFETCH(p) ((void)0)
+#endif
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * The getters for parent/left/right are deliberately
+ * not virtual: derived nodes for other kinds of search
+ * trees (AVL, Red Black, Splay) redeclare them to return
+ * their own pointer type, so every traversal step is a
+ * plain load and nodes carry no vtable pointer.
+ *
+ * The two low bits of the parent link are always zero
+ * for an aligned node, so they are free for derived
+ * nodes to keep a small tag in (AVLNode keeps its
+ * balance there). getParent() masks them off.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    template<typename... Args>
+    Node(Node<Key, Value>* parent, Args&&... itemArgs);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,18 +62,24 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
+    static const std::uintptr_t TAG_MASK = 3;
+
+    unsigned getTag() const;
+    void setTag(unsigned tag);
+
     std::pair<const Key, Value> item_;
-    Node<Key, Value>* parent_;
+    std::uintptr_t parent_;     // parent pointer | 2-bit tag
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
 };
@@ -54,11 +96,26 @@ protected:
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
     item_(key, value),
-    parent_(parent),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
     left_(NULL),
     right_(NULL)
 {
+    static_assert(alignof(Node<Key, Value>) > TAG_MASK, "tag bits need an aligned node");
+}
 
+/**
+* Constructor that builds the item in place from any arguments a
+* std::pair<const Key, Value> constructor accepts (including
+* std::piecewise_construct), so nothing is copied on the way in.
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+Node<Key, Value>::Node(Node<Key, Value>* parent, Args&&... itemArgs) :
+    item_(std::forward<Args>(itemArgs)...),
+    parent_(reinterpret_cast<std::uintptr_t>(parent)),
+    left_(NULL),
+    right_(NULL)
+{
 }
 
 /**
@@ -118,16 +175,16 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
 {
-    return parent_;
+    return reinterpret_cast<Node<Key, Value>*>(parent_ & ~TAG_MASK);
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +193,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -145,12 +202,13 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
 }
 
 /**
-* A setter for setting the parent of a node.
+* A setter for setting the parent of a node. The tag bits belong to
+* the node, not the link, so they are kept.
 */
 template<typename Key, typename Value>
 void Node<Key, Value>::setParent(Node<Key, Value>* parent)
 {
-    parent_ = parent;
+    parent_ = reinterpret_cast<std::uintptr_t>(parent) | (parent_ & TAG_MASK);
 }
 
 /**
@@ -171,6 +229,24 @@ void Node<Key, Value>::setRight(Node<Key, Value>* right)
     right_ = right;
 }
 
+/**
+* A getter for the 2-bit tag stored in the parent link.
+*/
+template<typename Key, typename Value>
+unsigned Node<Key, Value>::getTag() const
+{
+    return static_cast<unsigned>(parent_ & TAG_MASK);
+}
+
+/**
+* A setter for the 2-bit tag stored in the parent link.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTag(unsigned tag)
+{
+    parent_ = (parent_ & ~TAG_MASK) | (tag & TAG_MASK);
+}
+
 /**
 * A setter for the value of a node.
 */
@@ -180,6 +256,15 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter for the value of a node that moves from its argument.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -187,30 +272,107 @@ void Node<Key, Value>::setValue(const Value& value)
 */
 
 /**
-* A templated unbalanced binary search tree.
+* Three-way key comparison under a tree's Compare: negative if a orders
+* before b, positive if after, zero if neither does. The search loops
+* branch on this once per node instead of asking comp(a, b) and then
+* comp(b, a).
+*
+* A comparator can supply a cheaper version as a member
+* `int compare(const A& a, const B& b) const`; std::less on strings uses
+* std::basic_string::compare. Anything else costs up to two calls.
+*/
+template<typename Compare, typename A, typename B>
+auto compareKeysImpl(const Compare& comp, const A& a, const B& b, int)
+    -> decltype(static_cast<int>(comp.compare(a, b)))
+{
+    return static_cast<int>(comp.compare(a, b));
+}
+
+template<typename CharT, typename Traits, typename Alloc>
+int compareKeysImpl(const std::less<std::basic_string<CharT, Traits, Alloc> >&,
+    const std::basic_string<CharT, Traits, Alloc>& a, const std::basic_string<CharT, Traits, Alloc>& b, int)
+{
+    return a.compare(b);
+}
+
+template<typename Compare, typename A, typename B>
+int compareKeysImpl(const Compare& comp, const A& a, const B& b, long)
+{
+    if (comp(a, b)) return -1;
+    return comp(b, a) ? 1 : 0;
+}
+
+template<typename Compare, typename A, typename B>
+int compareKeys(const Compare& comp, const A& a, const B& b)
+{
+    return compareKeysImpl(comp, a, b, 0);
+}
+
+/**
+* In-order neighbour links for threaded trees (see AVLOptions). A tree
+* whose nodes carry these sets threadOffset_ to where they sit inside a
+* node, and its iterators then step by following next/prev instead of
+* climbing parent links.
 */
 template <typename Key, typename Value>
+struct ThreadLinks
+{
+    Node<Key, Value>* next;
+    Node<Key, Value>* prev;
+};
+
+/**
+* A templated unbalanced binary search tree, ordered by Compare (a strict
+* weak ordering on keys, std::less<Key> by default). If Compare defines
+* is_transparent, find() also accepts any type it can compare with Key.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp);
+    // Copies clone the tree shape node for node in O(n); moves are O(1)
+    // and leave the source empty.
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other) noexcept;
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other) noexcept;
     virtual ~BinarySearchTree(); //TODO
+    void swap(BinarySearchTree& other);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    virtual void insert(std::pair<const Key, Value>&& keyValuePair);
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
 
+    std::size_t bytesReserved() const;
+    Compare key_comp() const;
+    // An immutable, pointer-free copy for read-mostly lookups; O(n).
+    FrozenTree<Key, Value, Compare> freeze() const;
+
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: operator-- steps to the predecessor, and
+    * decrementing end() gives the last item, which is why an iterator
+    * also remembers its tree. A full walk in either direction costs O(n)
+    * in total, O(1) amortized per step; in a threaded tree every step is
+    * O(1).
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,41 +382,227 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        friend class const_iterator;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare>* tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator. Any iterator converts to a
+    * const_iterator, so the two can be compared and mixed freely.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        const Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare>* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A half-open run of items [begin(), end()) in key order, as returned
+    * by range(). It only holds two iterators, so it is cheap to copy and
+    * works with range-based for loops.
+    */
+    class range_view
+    {
+    public:
+        range_view(iterator first, iterator last);
+
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+
+    private:
+        iterator first_;
+        iterator last_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    // descending order; rbegin() is the largest key
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    // heterogeneous lookup, only with a transparent Compare
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    // Finger search: the same lookup, started from the item at hint (from
+    // the largest item for end()) instead of the root. It climbs only to
+    // the lowest subtree around hint that can hold key, so its cost grows
+    // with the height of that subtree: O(1) comparisons for a neighbour of
+    // hint, O(log d) for a key d items away unless the two sit on either
+    // side of a high node, and never much more than a plain find.
+    iterator find(iterator hint, const Key& key) const;
+
+    // Ordered lookups, each a single O(log n) descent (O(depth) for an
+    // unbalanced tree). lower_bound is the first item not before key,
+    // upper_bound the first item after it. range(lo, hi) holds the items
+    // with lo <= key < hi; walking it costs O(log n + k) for k items.
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    range_view range(const Key& lo, const Key& hi) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    range_view range(const K& lo, const K& hi) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    // Looks up every key in [first, last) and writes one iterator per key
+    // to out, end() for a miss; returns out past the last one written.
+    // Lookups run in groups that step down the tree together, each
+    // prefetching its next node, so their cache misses overlap.
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const;
+
+    // insert() with the slot found by a finger search from hint, as in
+    // find(hint, key); returns an iterator to the item. The tree keeps
+    // track of its largest node, so a key after all others takes O(1)
+    // comparisons whatever the hint; end() or the previous result both
+    // suit a stream of mostly rising keys.
+    iterator insert(iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    iterator insert(iterator hint, std::pair<const Key, Value>&& keyValuePair);
+
+    // Unlike insert(), these never overwrite an existing value. The bool is
+    // true if a new node was added.
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+    // remove() for an item already at hand: pos must point into this tree,
+    // and its key is not looked up again. Returns the item after it.
+    // erase(first, last) removes the items in [first, last) and returns
+    // last, in O(h + k) for k items in a tree of height h: after the
+    // first few, each removal finds its successor and predecessor within
+    // a step or two of the last one.
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+
 protected:
+    BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp = Compare());
+    iterator makeIterator(Node<Key, Value>* node) const;
+    static Node<Key, Value>* iteratorNode(const iterator& it);
+
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
-    virtual void printRoot (Node<Key, Value> *r) const;
+    void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2);
+    // unlinks and destroys node; remove() and erase() both end here
+    virtual void removeNode(Node<Key, Value>* node);
+    Node<Key, Value>* splicePredecessor(Node<Key, Value>* target, Node<Key, Value>* pred);
 
     // Add helper functions here
     static Node<Key, Value>* successor(Node<Key, Value>* current);
+    ThreadLinks<Key, Value>* threadLinks(const Node<Key, Value>* node) const;
+    Node<Key, Value>* nextNode(const Node<Key, Value>* node) const;
+    Node<Key, Value>* prevNode(const Node<Key, Value>* node) const;
     void deleteTree(Node<Key, Value>* node);
-    
-
+    template<typename NodeType, typename... Args>
+    NodeType* createNode(NodeType* parent, Args&&... itemArgs);
+    template<typename NodeType>
+    NodeType* cloneNode(const Node<Key, Value>* src, Node<Key, Value>* parent);
+    template<typename NodeType>
+    Node<Key, Value>* cloneTree(const Node<Key, Value>* src);
+    virtual void destroyNode(Node<Key, Value>* node);
+    template<typename K>
+    Node<Key, Value>* findNode(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* lowerBoundNode(const K& key) const;
+    template<typename K>
+    Node<Key, Value>* upperBoundNode(const K& key) const;
+    template<typename K>
+    std::pair<iterator, iterator> equalRange(const K& key) const;
+    template<typename K>
+    range_view makeRange(const K& lo, const K& hi) const;
+    Node<Key, Value>* findSlot(const Key& key, Node<Key, Value>*& parent, bool& asLeft) const;
+    Node<Key, Value>* fingerSlot(Node<Key, Value>* hint, const Key& key,
+        Node<Key, Value>*& parent, bool& asLeft) const;
+    Node<Key, Value>* descendSlot(Node<Key, Value>* curr, const Key& key,
+        Node<Key, Value>*& parent, bool& asLeft) const;
+    void linkNode(Node<Key, Value>* parent, Node<Key, Value>* node, bool asLeft);
+    template<typename NodeType, typename... Args>
+    std::pair<Node<Key, Value>*, bool> insertUnique(const Key& key, Args&&... itemArgs);
+    template<typename NodeType, typename... Args>
+    std::pair<Node<Key, Value>*, bool> emplaceUnique(Args&&... itemArgs);
+    template<typename NodeType, typename Pair>
+    std::pair<Node<Key, Value>*, bool> insertOrAssignNear(const iterator& hint, Pair&& keyValuePair);
+
+    // insert() is virtual and so always compiled; these pick between a real
+    // insert-or-assign and a throwing stub so move-only (or immovable) values
+    // still work with emplace/try_emplace and the insert overload they support.
+    typedef std::integral_constant<bool, std::is_copy_constructible<Key>::value &&
+        std::is_copy_constructible<Value>::value && std::is_copy_assignable<Value>::value> CopyableItem;
+    typedef std::integral_constant<bool, std::is_copy_constructible<Key>::value &&
+        std::is_move_constructible<Value>::value && std::is_move_assignable<Value>::value> MovableItem;
+    template<typename NodeType, typename Pair>
+    std::pair<Node<Key, Value>*, bool> insertOrAssign(Pair&& keyValuePair, std::true_type);
+    template<typename NodeType, typename Pair>
+    std::pair<Node<Key, Value>*, bool> insertOrAssign(Pair&& keyValuePair, std::false_type);
+
+
+    // lookups find_many() keeps in flight at once
+    static const std::size_t FIND_MANY_GROUP = 16;
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    // the largest node, so appends with a hint need not climb to the
+    // root; NULL when not known
+    Node<Key, Value>* largest_;
+    NodePool pool_;
+    Compare comp_;
+    // byte offset of the ThreadLinks inside each node, 0 if unthreaded
+    std::size_t threadOffset_;
 };
 
 /*
@@ -266,28 +614,30 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr,
+    const BinarySearchTree<Key, Value, Compare>* tree)
 {
     current_ = ptr;
+    tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     current_ = nullptr;
-
+    tree_ = nullptr;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -295,9 +645,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -306,10 +656,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // compare internal node ptrs
     return current_ == rhs.current_;
@@ -319,10 +669,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     // compare internal node ptrs
     return current_ != rhs.current_;
@@ -333,288 +683,1294 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing (go to successr)
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
     // advance iterator to in-order successor of current_
-    current_ = BinarySearchTree<Key, Value>::successor(current_);
+    current_ = tree_->nextNode(current_);
     return *this;
 }
 
-
-/*
--------------------------------------------------------------
-End implementations for the BinarySearchTree::iterator class.
--------------------------------------------------------------
-*/
-
-/*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
-*/
-
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Advances the iterator and returns its old position.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator++(int)
 {
-    root_ = nullptr;
+    iterator old = *this;
+    ++*this;
+    return old;
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Moves the iterator back to the in-order predecessor; from end() that
+* is the largest item.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
 {
-    clear();
+    if (current_ == nullptr) {
+        current_ = tree_->getLargestNode();
+    }
+    else {
+        current_ = tree_->prevNode(current_);
+    }
+    return *this;
 }
 
 /**
- * Returns true if tree is empty
+* Moves the iterator back and returns its old position.
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator--(int)
 {
-    return root_ == NULL;
+    iterator old = *this;
+    --*this;
+    return old;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+
+/*
+-------------------------------------------------------------
+End implementations for the BinarySearchTree::iterator class.
+-------------------------------------------------------------
+*/
+
+/*
+---------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+---------------------------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator() :
+    current_(nullptr),
+    tree_(nullptr)
 {
-    printRoot(root_);
-    std::cout << "\n";
 }
 
 /**
-* Returns an iterator to the "smallest" item in the tree
+* Converts a mutable iterator to a read-only one at the same position.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(const iterator& it) :
+    current_(it.current_),
+    tree_(it.tree_)
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
 }
 
 /**
-* Returns an iterator whose value means INVALID
+* Provides read-only access to the item.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator*() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    return current_->getItem();
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+* Provides the address of the item.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator->() const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    return &(current_->getItem());
 }
 
-/**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return current_ == rhs.current_;
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    return current_ != rhs.current_;
 }
 
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Advances to the in-order successor, as iterator::operator++ does.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++()
 {
-    // tree is empty! create root
-    if (root_ == nullptr) {
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-        return;
-    }
-
-    // get key and value - readability thing
-    const Key& key = keyValuePair.first;
-    const Value& value = keyValuePair.second;
-
-    // tree is not empty -- start traversal from root
-    Node<Key, Value>* curr = root_;
-    Node<Key, Value>* parent = nullptr;
-
-    // traverse tree to find correct insertion point
-    while (curr != nullptr) {
-        parent = curr;
-        // desired less than go left
-        if (key < curr->getKey()) {
-            curr = curr->getLeft();
-        }
-        // desired more than, go right
-        else if (key > curr->getKey()) {
-            curr = curr->getRight();
-        }
-        // key is found
-        else {
-            // update value
-            curr->setValue(value);
-            return;
-        }
-    }
-
-    // insert new node as child of parent
-    Node<Key, Value>* newNode = new Node<Key, Value>(key, value, parent);
-    // left child or right child depending on key
-    if (key < parent->getKey()) {
-        parent->setLeft(newNode);
-    }
-    else {
-        parent->setRight(newNode);
-    }
+    current_ = tree_->nextNode(current_);
+    return *this;
 }
 
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old = *this;
+    ++*this;
+    return old;
+}
 
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Steps back to the in-order predecessor, as iterator::operator-- does.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--()
 {
-    // case 1 - node has two children
-    // - find predecessor
-    // - swap nodes using nodeSwap()
-    // - recurse on same key (node to delete now moved down)
-    // case 2 - node has one child
-    // - promote the child (adjust pointers)
-    // case 3 - node is a leaf
-    // - unlink from parent and delte
-
-    // get node to remove
-    Node<Key, Value>* target = internalFind(key);
-    if (target == nullptr) return; // key not found!
-
-    // two children present
-    if (target->getLeft() != nullptr && target->getRight() != nullptr) {
-        // find predecessor (max/rightmost of left subtree)
-        Node<Key, Value>* pred = predecessor(target);
-        // swap actual nodes
-        nodeSwap(target, pred);
-        // now original key is lower in tree - continue
-    }
-
-    // get one child if any (null if target is leaf)
-    Node<Key, Value>* child = (target->getLeft() != nullptr) ? target->getLeft() : target->getRight();
-
-    Node<Key, Value>* parent = target->getParent();
-
-    // reconnect child to parent if child exists
-    if (child != nullptr) {
-        // promote the child
-        child->setParent(parent);
-    }
-
-    // node is root
-    if (parent == nullptr) {
-        root_ = child;
-    }
-    else if (parent->getLeft() == target) {
-        parent->setLeft(child);
+    if (current_ == nullptr) {
+        current_ = tree_->getLargestNode();
     }
     else {
-        parent->setRight(child);
+        current_ = tree_->prevNode(current_);
     }
-
-    delete target;
-
+    return *this;
 }
 
-
-
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--(int)
 {
-    if (current == nullptr) return nullptr;
+    const_iterator old = *this;
+    --*this;
+    return old;
+}
 
-    // case 1: has left subtree — go to rightmost node in left subtree
-    if (current->getLeft() != nullptr) {
-        current = current->getLeft();
-        while (current->getRight() != nullptr) {
-            current = current->getRight();
-        }
-        return current;
-    }
+/*
+-------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+-------------------------------------------------------------------
+*/
 
-    // case 2: no left subtree — move up until current is a right child
-    Node<Key, Value>* parent = current->getParent();
-    while (parent != nullptr && current == parent->getLeft()) {
-        current = parent;
-        parent = parent->getParent();
-    }
+/*
+-----------------------------------------------------------------
+Begin implementations for the BinarySearchTree::range_view class.
+-----------------------------------------------------------------
+*/
 
-    return parent;
+/**
+* Wraps the half-open run [first, last).
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::range_view::range_view(iterator first, iterator last) :
+    first_(first),
+    last_(last)
+{
 }
 
-
 /**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* Returns an iterator to the first item in the run.
 */
-
-// helper for deletion of nodes with node parameter
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::deleteTree(Node<Key, Value>* node)
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::range_view::begin() const
 {
-    if (node == nullptr) return;
-
-    deleteTree(node->getLeft());
-    deleteTree(node->getRight());
-    delete node;
+    return first_;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+/**
+* Returns an iterator just past the last item in the run.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::range_view::end() const
 {
-    deleteTree(root_);
-    root_ = nullptr;
+    return last_;
 }
 
 /**
-* A helper function to find the smallest node in the tree.
+* Returns true if the run holds no items.
 */
-template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::range_view::empty() const
 {
-    // smallest node in the tree is the leftmost node!
+    return first_ == last_;
+}
 
-    // current node
-    Node<Key, Value>* curr = root_;
+/*
+---------------------------------------------------------------
+End implementations for the BinarySearchTree::range_view class.
+---------------------------------------------------------------
+*/
 
-    // tree doesnt exist
-    if (curr == nullptr) return nullptr;
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+/**
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree() :
+    root_(nullptr),
+    largest_(nullptr),
+    pool_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)),
+    comp_(),
+    threadOffset_(0)
+{
+}
+
+/**
+* Constructor for a tree ordered by the given comparator object.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    root_(nullptr),
+    largest_(nullptr),
+    pool_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)),
+    comp_(comp),
+    threadOffset_(0)
+{
+}
+
+/**
+* Constructor used by derived trees whose nodes are larger than a plain
+* Node, so the node pool hands out slots of the right size.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp) :
+    root_(nullptr),
+    largest_(nullptr),
+    pool_(nodeSize, nodeAlign),
+    comp_(comp),
+    threadOffset_(0)
+{
+}
+
+/**
+* Copy constructor: an exact copy of other's shape, built without a
+* single comparison.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const BinarySearchTree& other) :
+    root_(nullptr),
+    largest_(nullptr),
+    pool_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>)),
+    comp_(other.comp_),
+    threadOffset_(0)
+{
+    root_ = cloneTree<Node<Key, Value> >(other.root_);
+}
+
+/**
+* Move constructor: takes over other's nodes and leaves it empty.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(BinarySearchTree&& other) noexcept :
+    root_(nullptr),
+    largest_(nullptr),
+    pool_(other.pool_.nodeSize(), other.pool_.nodeAlign()),
+    comp_(other.comp_),
+    threadOffset_(other.threadOffset_)
+{
+    swap(other);
+}
+
+/**
+* Copy assignment. The copy is made first, so if it throws this tree is
+* left as it was.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>&
+BinarySearchTree<Key, Value, Compare>::operator=(const BinarySearchTree& other)
+{
+    if (this != &other) {
+        BinarySearchTree<Key, Value, Compare> copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+/**
+* Move assignment: drops this tree's nodes and takes over other's.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>&
+BinarySearchTree<Key, Value, Compare>::operator=(BinarySearchTree&& other) noexcept
+{
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
+{
+    clear();
+}
+
+/**
+* Exchanges the contents of two trees in O(1).
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::swap(BinarySearchTree& other)
+{
+    using std::swap;
+    swap(root_, other.root_);
+    swap(largest_, other.largest_);
+    pool_.swap(other.pool_);
+    swap(comp_, other.comp_);
+    swap(threadOffset_, other.threadOffset_);
+}
+
+/**
+* Wraps a node pointer in an iterator for derived trees, which cannot
+* reach the iterator's protected constructor themselves.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* The node an iterator points at, NULL for end(); the way back from
+* makeIterator.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::iteratorNode(const iterator& it)
+{
+    return it.current_;
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+ * Returns the number of bytes the node pool currently holds
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::bytesReserved() const
+{
+    return pool_.bytesReserved();
+}
+
+/**
+ * Returns a copy of the comparator that orders the keys
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+ * Copies the items, in order, into a FrozenTree. Later changes to this
+ * tree do not show in it.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare> BinarySearchTree<Key, Value, Compare>::freeze() const
+{
+    return FrozenTree<Key, Value, Compare>(cbegin(), cend(), comp_);
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator begin(getSmallestNode(), this);
+    return begin;
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL, this);
+    return end;
+}
+
+/**
+* Read-only versions of begin() and end()
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cbegin() const
+{
+    return begin();
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cend() const
+{
+    return end();
+}
+
+/**
+* Returns a reverse iterator to the "largest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+/**
+* Returns the reverse iterator past the "smallest" item
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
+{
+    Node<Key, Value> *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr, this);
+    return it;
+}
+
+/**
+* Same as above for a key of another type, which is compared with the
+* stored keys directly so no Key has to be built for the lookup.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K& k) const
+{
+    return makeIterator(findNode(k));
+}
+
+/**
+* Finger search from hint; see fingerSlot.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(iterator hint, const Key& key) const
+{
+    Node<Key, Value>* parent;
+    bool asLeft;
+    return makeIterator(fingerSlot(hint.current_, key, parent, asLeft));
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return makeIterator(lowerBoundNode(key));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return makeIterator(upperBoundNode(key));
+}
+
+/**
+* Returns [lower_bound(key), upper_bound(key)), which holds the item with
+* the given key or nothing, from a single descent.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+    typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    return equalRange(key);
+}
+
+/**
+* Returns a view of the items with lo <= key < hi, empty unless lo is
+* before hi.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::range_view
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const
+{
+    return makeRange(lo, hi);
+}
+
+/**
+* Heterogeneous versions of the ordered lookups above, for a transparent
+* Compare.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K& key) const
+{
+    return makeIterator(lowerBoundNode(key));
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const K& key) const
+{
+    return makeIterator(upperBoundNode(key));
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+    typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const K& key) const
+{
+    return equalRange(key);
+}
+
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::range_view
+BinarySearchTree<Key, Value, Compare>::range(const K& lo, const K& hi) const
+{
+    return makeRange(lo, hi);
+}
+
+/**
+* Each round moves every unfinished lookup in the group one level down
+* and prefetches the node it lands on, which the next round compares
+* against. A lookup is finished once its node matches or runs out.
+*/
+template<class Key, class Value, class Compare>
+template<typename ForwardIt, typename OutputIt>
+OutputIt BinarySearchTree<Key, Value, Compare>::find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+{
+    ForwardIt keys[FIND_MANY_GROUP];
+    Node<Key, Value>* nodes[FIND_MANY_GROUP];
+    bool found[FIND_MANY_GROUP];
+    while (first != last) {
+        std::size_t group = 0;
+        for (; group < FIND_MANY_GROUP && first != last; ++first, ++group) {
+            keys[group] = first;
+            nodes[group] = root_;
+            found[group] = false;
+        }
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            for (std::size_t i = 0; i < group; i++) {
+                Node<Key, Value>* curr = nodes[i];
+                if (curr == nullptr || found[i]) continue;
+                int cmp = compareKeys(comp_, *keys[i], curr->getKey());
+                if (cmp == 0) {
+                    found[i] = true;
+                    continue;
+                }
+                curr = cmp < 0 ? curr->getLeft() : curr->getRight();
+                nodes[i] = curr;
+                if (curr != nullptr) {
+                    BST_PREFETCH(curr);
+                    pending = true;
+                }
+            }
+        }
+        for (std::size_t i = 0; i < group; i++) {
+            *out = found[i] ? makeIterator(nodes[i]) : end();
+            ++out;
+        }
+    }
+    return out;
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    insertOrAssign<Node<Key, Value> >(keyValuePair, CopyableItem());
+}
+
+/**
+* Same as above, but the new item (or the overwriting value) is moved
+* out of keyValuePair instead of copied.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    insertOrAssign<Node<Key, Value> >(std::move(keyValuePair), MovableItem());
+}
+
+/**
+* Inserts or overwrites like insert(), but finds the slot starting from
+* hint; see fingerSlot.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    return makeIterator(insertOrAssignNear<Node<Key, Value> >(hint, keyValuePair).first);
+}
+
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(iterator hint, std::pair<const Key, Value>&& keyValuePair)
+{
+    return makeIterator(insertOrAssignNear<Node<Key, Value> >(hint, std::move(keyValuePair)).first);
+}
+
+/**
+* Builds the item in place from args and inserts it if its key is not
+* already present. The existing value is left alone otherwise.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        emplaceUnique<Node<Key, Value> >(std::forward<Args>(args)...);
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+/**
+* Inserts key with a value built from args, but only if key is not
+* already present; in that case the value is never constructed.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertUnique<Node<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = insertUnique<Node<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::make_pair(makeIterator(result.first), result.second);
+}
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
+{
+    // get node to remove
+    Node<Key, Value>* target = internalFind(key);
+    if (target == nullptr) return; // key not found!
+    removeNode(target);
+}
+
+/**
+* Removes the item at pos and returns an iterator to the one after it.
+* The successor is found before the removal; removals move nodes rather
+* than items, so it still holds the same item afterwards.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator pos)
+{
+    Node<Key, Value>* next = nextNode(pos.current_);
+    removeNode(pos.current_);
+    return makeIterator(next);
+}
+
+/**
+* Removes [first, last) in key order. With the earlier items gone, a
+* node with two children has the item before first as its predecessor,
+* and each such removal lifts that item into the removed node's place,
+* so the predecessor walks add up to one root-to-leaf path.
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::erase(iterator first, iterator last)
+{
+    while (first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+/**
+* Unlinks node from the tree and destroys it.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeNode(Node<Key, Value>* target)
+{
+    // case 1 - node has two children
+    // - find predecessor
+    // - splice it into the node's place
+    // case 2 - node has one child
+    // - promote the child (adjust pointers)
+    // case 3 - node is a leaf
+    // - unlink from parent and delte
+
+    // two children present
+    if (target->getLeft() != nullptr && target->getRight() != nullptr) {
+        // find predecessor (max/rightmost of left subtree) and move it up
+        splicePredecessor(target, predecessor(target));
+    }
+    else {
+        // get one child if any (null if target is leaf)
+        Node<Key, Value>* child = (target->getLeft() != nullptr) ? target->getLeft() : target->getRight();
+
+        Node<Key, Value>* parent = target->getParent();
+
+        // reconnect child to parent if child exists
+        if (child != nullptr) {
+            // promote the child
+            child->setParent(parent);
+        }
+
+        // node is root
+        if (parent == nullptr) {
+            root_ = child;
+        }
+        else if (parent->getLeft() == target) {
+            parent->setLeft(child);
+        }
+        else {
+            parent->setRight(child);
+        }
+    }
+
+    if (target == largest_) {
+        largest_ = nullptr;
+    }
+    destroyNode(target);
+
+}
+
+/**
+* Unlinks target, a node with two children, by moving pred, its
+* predecessor, into its place: pred's left child takes pred's old slot,
+* and pred takes target's links. Every node keeps its item, so iterators
+* to anything but target stay valid. This is the pointer work of a
+* nodeSwap followed by unlinking target, minus the half that nodeSwap
+* spends moving target down, and without its cases for neighbours.
+* Returns the parent of the slot pred left, where rebalancing starts:
+* pred itself when it was target's left child (its left slot lost the
+* node), otherwise pred's old parent (its right slot did).
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::splicePredecessor(Node<Key, Value>* target, Node<Key, Value>* pred)
+{
+    Node<Key, Value>* parent = pred->getParent();
+    if (parent != target) {
+        Node<Key, Value>* child = pred->getLeft();
+        parent->setRight(child);
+        if (child != nullptr) {
+            child->setParent(parent);
+        }
+        pred->setLeft(target->getLeft());
+        target->getLeft()->setParent(pred);
+    }
+    else {
+        parent = pred;
+    }
+    pred->setRight(target->getRight());
+    target->getRight()->setParent(pred);
+
+    Node<Key, Value>* up = target->getParent();
+    pred->setParent(up);
+    if (up == nullptr) {
+        root_ = pred;
+    }
+    else if (up->getLeft() == target) {
+        up->setLeft(pred);
+    }
+    else {
+        up->setRight(pred);
+    }
+    return parent;
+}
+
+
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
+{
+    if (current == nullptr) return nullptr;
+
+    // case 1: has left subtree — go to rightmost node in left subtree
+    if (current->getLeft() != nullptr) {
+        current = current->getLeft();
+        while (current->getRight() != nullptr) {
+            current = current->getRight();
+        }
+        return current;
+    }
+
+    // case 2: no left subtree — move up until current is a right child
+    Node<Key, Value>* parent = current->getParent();
+    while (parent != nullptr && current == parent->getLeft()) {
+        current = parent;
+        parent = parent->getParent();
+    }
+
+    return parent;
+}
+
+
+/**
+* Constructs a node in storage taken from the tree's node pool. The
+* item is built in place from itemArgs.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename... Args>
+NodeType* BinarySearchTree<Key, Value, Compare>::createNode(NodeType* parent, Args&&... itemArgs)
+{
+    void* slot = pool_.allocate();
+    try {
+        return new (slot) NodeType(parent, std::forward<Args>(itemArgs)...);
+    }
+    catch (...) {
+        pool_.deallocate(slot);
+        throw;
+    }
+}
+
+/**
+* Copy-constructs src as a NodeType, which carries over everything a
+* derived node keeps next to the item (an AVL balance, a subtree size),
+* then hangs the copy under parent with no children yet.
+*/
+template<class Key, class Value, class Compare>
+template<typename NodeType>
+NodeType* BinarySearchTree<Key, Value, Compare>::cloneNode(const Node<Key, Value>* src, Node<Key, Value>* parent)
+{
+    void* slot = pool_.allocate();
+    NodeType* node;
+    try {
+        node = new (slot) NodeType(*static_cast<const NodeType*>(src));
+    }
+    catch (...) {
+        pool_.deallocate(slot);
+        throw;
+    }
+    node->setParent(parent);
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+    return node;
+}
+
+/**
+* Copies the subtree under src into this tree with the same shape and
+* returns its root. The walk follows parent links rather than
+* recursing, so any depth is fine. If copying an item throws, the
+* nodes made so far are destroyed and the exception passes on.
+*/
+template<class Key, class Value, class Compare>
+template<typename NodeType>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::cloneTree(const Node<Key, Value>* src)
+{
+    if (src == nullptr) return nullptr;
+    Node<Key, Value>* root = cloneNode<NodeType>(src, nullptr);
+    const Node<Key, Value>* from = src;
+    Node<Key, Value>* to = root;
+    try {
+        while (true) {
+            // a child that is missing in the copy has not been visited yet
+            if (from->getLeft() != nullptr && to->getLeft() == nullptr) {
+                to->setLeft(cloneNode<NodeType>(from->getLeft(), to));
+                from = from->getLeft();
+                to = to->getLeft();
+            }
+            else if (from->getRight() != nullptr && to->getRight() == nullptr) {
+                to->setRight(cloneNode<NodeType>(from->getRight(), to));
+                from = from->getRight();
+                to = to->getRight();
+            }
+            else if (from == src) {
+                break;
+            }
+            else {
+                from = from->getParent();
+                to = to->getParent();
+            }
+        }
+    }
+    catch (...) {
+        deleteTree(root);
+        throw;
+    }
+    return root;
+}
+
+/**
+* Destroys a single node and returns its slot to the node pool.
+* Node has no virtual destructor, so trees with derived nodes
+* override this to run the right destructor.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node();
+    pool_.deallocate(node);
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*/
+
+// helper for destroying the nodes of a subtree; their blocks are freed by the pool afterwards.
+// Walks down to a leaf, unlinks and destroys it, then continues from its parent,
+// so it needs no stack however deep the subtree is.
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::deleteTree(Node<Key, Value>* node)
+{
+    Node<Key, Value>* curr = node;
+    while (curr != nullptr) {
+        if (curr->getLeft() != nullptr) {
+            curr = curr->getLeft();
+        }
+        else if (curr->getRight() != nullptr) {
+            curr = curr->getRight();
+        }
+        else {
+            // leaf: detach it from its parent unless it is the subtree root
+            Node<Key, Value>* parent = (curr == node) ? nullptr : curr->getParent();
+            if (parent != nullptr) {
+                if (parent->getLeft() == curr) parent->setLeft(nullptr);
+                else parent->setRight(nullptr);
+            }
+            destroyNode(curr);
+            curr = parent;
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
+{
+    // keys and values with trivial destructors need no walk at all,
+    // the whole tree goes away with its blocks
+    if (!std::is_trivially_destructible<std::pair<const Key, Value> >::value) {
+        deleteTree(root_);
+    }
+    pool_.release();
+    root_ = nullptr;
+    largest_ = nullptr;
+}
+
+/**
+* Walks down to where key belongs. Returns the node holding key, or
+* NULL with parent set to the node a new key would hang off (NULL if
+* the tree is empty) and asLeft telling on which side.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::findSlot(const Key& key, Node<Key, Value>*& parent, bool& asLeft) const
+{
+    parent = nullptr;
+    asLeft = false;
+    return descendSlot(root_, key, parent, asLeft);
+}
+
+/**
+* The walk behind findSlot, from curr down; parent and asLeft must
+* already say where curr hangs.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::descendSlot(Node<Key, Value>* curr, const Key& key,
+    Node<Key, Value>*& parent, bool& asLeft) const
+{
+    // traverse tree to find correct insertion point
+    while (curr != nullptr) {
+        parent = curr;
+        int cmp = compareKeys(comp_, key, curr->getKey());
+        // key is found
+        if (cmp == 0) {
+            return curr;
+        }
+        // desired less than go left, more than go right
+        asLeft = cmp < 0;
+        curr = asLeft ? curr->getLeft() : curr->getRight();
+    }
+    return nullptr;
+}
+
+/**
+* findSlot for a search that starts at hint (at the largest node if hint
+* is NULL) instead of the root. Say key is after hint. The ancestors that
+* hold hint in their right subtree are all before it and can be skipped;
+* the next one up, bound, holds it in its left subtree, so everything
+* between hint and bound lies in hint's right subtree. While bound is
+* not after key the walk moves up to it and repeats. Then it descends
+* from where it stopped. A key before hint is the mirror image. A key
+* after the largest node, when that is known, is placed at once.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::fingerSlot(Node<Key, Value>* hint, const Key& key,
+    Node<Key, Value>*& parent, bool& asLeft) const
+{
+    Node<Key, Value>* curr = hint;
+    if (curr == nullptr) {
+        curr = largest_ != nullptr ? largest_ : getLargestNode();
+    }
+    if (curr == nullptr) return findSlot(key, parent, asLeft);
+    parent = curr;
+    int cmp = compareKeys(comp_, key, curr->getKey());
+    if (cmp == 0) return curr;
+    bool after = cmp > 0;
+
+    // An append hangs right of the largest node whatever the hint; the
+    // climb would only find that out at the root.
+    if (after && largest_ != nullptr && curr != largest_) {
+        int last = compareKeys(comp_, key, largest_->getKey());
+        if (last >= 0) {
+            parent = largest_;
+            asLeft = false;
+            return last == 0 ? largest_ : nullptr;
+        }
+    }
+    for (;;) {
+        // nothing follows the largest node
+        if (after && curr == largest_) break;
+        Node<Key, Value>* child = curr;
+        Node<Key, Value>* bound = curr->getParent();
+        while (bound != nullptr && (after ? bound->getRight() : bound->getLeft()) == child) {
+            child = bound;
+            bound = bound->getParent();
+        }
+        if (bound == nullptr) break;
+        cmp = compareKeys(comp_, key, bound->getKey());
+        if (cmp == 0) {
+            parent = bound;
+            return bound;
+        }
+        // key falls between curr and bound
+        if ((cmp > 0) != after) break;
+        curr = bound;
+    }
+    parent = curr;
+    asLeft = !after;
+    return descendSlot(asLeft ? curr->getLeft() : curr->getRight(), key, parent, asLeft);
+}
+
+/**
+* Attaches node as a child of parent (or as the root if parent is NULL),
+* on the side findSlot reported.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* parent, Node<Key, Value>* node, bool asLeft)
+{
+    node->setParent(parent);
+    // a new largest node can only hang right of the old one
+    if (parent == largest_ && !asLeft) {
+        largest_ = node;
+    }
+    if (parent == nullptr) {
+        root_ = node;
+    }
+    // left child or right child depending on key
+    else if (asLeft) {
+        parent->setLeft(node);
+    }
+    else {
+        parent->setRight(node);
+    }
+}
+
+/**
+* Looks up key and, if it is missing, creates a NodeType from itemArgs
+* and links it in. Nothing is constructed when key already exists.
+* Returns the node holding key and whether it was inserted. Balanced
+* trees rebalance afterwards.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename... Args>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertUnique(const Key& key, Args&&... itemArgs)
+{
+    Node<Key, Value>* parent;
+    bool asLeft;
+    Node<Key, Value>* existing = findSlot(key, parent, asLeft);
+    if (existing != nullptr) {
+        return std::make_pair(existing, false);
+    }
+    NodeType* node = createNode(static_cast<NodeType*>(parent), std::forward<Args>(itemArgs)...);
+    linkNode(parent, node, asLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* Like insertUnique, but the key is only known once the item has been
+* built, so the node is created first and destroyed again if its key
+* turns out to be a duplicate.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename... Args>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::emplaceUnique(Args&&... itemArgs)
+{
+    NodeType* node = createNode(static_cast<NodeType*>(nullptr), std::forward<Args>(itemArgs)...);
+    Node<Key, Value>* parent;
+    bool asLeft;
+    Node<Key, Value>* existing = findSlot(node->getKey(), parent, asLeft);
+    if (existing != nullptr) {
+        destroyNode(node);
+        return std::make_pair(existing, false);
+    }
+    linkNode(parent, node, asLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* insertOrAssign for the hinted inserts, with the slot found by
+* fingerSlot. Those are not virtual, so they need no fallback for items
+* that cannot be copied or moved in.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename Pair>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertOrAssignNear(const iterator& hint, Pair&& keyValuePair)
+{
+    if (largest_ == nullptr) {
+        largest_ = getLargestNode();
+    }
+    Node<Key, Value>* parent;
+    bool asLeft;
+    Node<Key, Value>* existing = fingerSlot(hint.current_, keyValuePair.first, parent, asLeft);
+    if (existing != nullptr) {
+        existing->setValue(std::forward<Pair>(keyValuePair).second);
+        return std::make_pair(existing, false);
+    }
+    NodeType* node = createNode(static_cast<NodeType*>(parent), std::forward<Pair>(keyValuePair));
+    linkNode(parent, node, asLeft);
+    return std::make_pair(node, true);
+}
+
+/**
+* Inserts keyValuePair, copying or moving it depending on how it was
+* passed, or overwrites the value if the key is already present.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename Pair>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertOrAssign(Pair&& keyValuePair, std::true_type)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        insertUnique<NodeType>(keyValuePair.first, std::forward<Pair>(keyValuePair));
+    // key is found - update value (keyValuePair was not consumed)
+    if (!result.second) {
+        result.first->setValue(std::forward<Pair>(keyValuePair).second);
+    }
+    return result;
+}
+
+/**
+* Stub for item types that cannot be copied (or moved) the way the
+* insert overload needs.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NodeType, typename Pair>
+std::pair<Node<Key, Value>*, bool>
+BinarySearchTree<Key, Value, Compare>::insertOrAssign(Pair&&, std::false_type)
+{
+    throw std::logic_error("insert: item type does not support this overload; use emplace or try_emplace");
+}
+
+/**
+* A helper function to find the smallest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
+{
+    // smallest node in the tree is the leftmost node!
+
+    // current node
+    Node<Key, Value>* curr = root_;
+
+    // tree doesnt exist
+    if (curr == nullptr) return nullptr;
 
     // get to leftmost node - while node has a left child continue walking
     while (curr->getLeft() != nullptr) {
@@ -625,25 +1981,53 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
     return curr;
 }
 
+/**
+* A helper function to find the largest node in the tree. Kept out of line:
+* decrementing end() is the only iterator step that needs it.
+*/
+template<typename Key, typename Value, typename Compare>
+BST_NOINLINE Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getLargestNode() const
+{
+    Node<Key, Value>* curr = root_;
+    if (curr == nullptr) return nullptr;
+    while (curr->getRight() != nullptr) {
+        curr = curr->getRight();
+    }
+    return curr;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    return findNode(key);
+}
+
+/**
+* The lookup behind internalFind and find. K is Key, or any type a
+* transparent Compare can order against Key.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::findNode(const K& key) const
 {
     // traverse tree to find node
     Node<Key, Value>* curr = root_;
     
     // while current node is valid
     while (curr != nullptr) {
+        int cmp = compareKeys(comp_, key, curr->getKey());
         // go left if desired key less than current key
-        if (key < curr->getKey()) {
+        if (cmp < 0) {
             curr = curr->getLeft();
         }
         // go right if desired key more than current key
-        else if (key > curr->getKey()) {
+        else if (cmp > 0) {
             curr = curr->getRight();
         }
         // key is found
@@ -656,35 +2040,149 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
     return nullptr;
 }
 
-// helper to recursively get height or -1 if unbalanced
+/**
+* Descends once, remembering the last node where the walk turned left:
+* that is the smallest key not less than key. Stops early on an exact
+* match since keys are unique.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::lowerBoundNode(const K& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (curr != nullptr) {
+        int cmp = compareKeys(comp_, key, curr->getKey());
+        if (cmp == 0) {
+            return curr;
+        }
+        if (cmp < 0) {
+            bound = curr;
+            curr = curr->getLeft();
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    return bound;
+}
+
+/**
+* Like lowerBoundNode, but an exact match counts as "before" so the walk
+* carries on to its successor.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::upperBoundNode(const K& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* bound = nullptr;
+    while (curr != nullptr) {
+        if (comp_(key, curr->getKey())) {
+            bound = curr;
+            curr = curr->getLeft();
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    return bound;
+}
+
+/**
+* The lower bound plus, when it holds key itself, its successor.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator,
+    typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equalRange(const K& key) const
+{
+    Node<Key, Value>* first = lowerBoundNode(key);
+    Node<Key, Value>* last = first;
+    if (first != nullptr && !comp_(key, first->getKey())) {
+        last = nextNode(first);
+    }
+    return std::make_pair(makeIterator(first), makeIterator(last));
+}
+
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+typename BinarySearchTree<Key, Value, Compare>::range_view
+BinarySearchTree<Key, Value, Compare>::makeRange(const K& lo, const K& hi) const
+{
+    // an inverted range would otherwise run from lower_bound(lo) to end()
+    if (!comp_(lo, hi)) {
+        return range_view(end(), end());
+    }
+    return range_view(makeIterator(lowerBoundNode(lo)), makeIterator(lowerBoundNode(hi)));
+}
+
+// helper to get height or -1 if unbalanced.
+// Post-order walk over the parent links; the only extra space is the left
+// subtree height of each ancestor whose right subtree is being walked.
 template<typename Key, typename Value>
-int getHeightIfBalanced(Node<Key, Value>* node) {
-    if (node == nullptr) return 0;
-    
-    int left = getHeightIfBalanced(node->getLeft());
-    if (left == -1) return -1;
-    
-    int right = getHeightIfBalanced(node->getRight());
-    if (right == -1) return -1;
+int getHeightIfBalanced(Node<Key, Value>* root) {
+    if (root == nullptr) return 0;
+
+    std::vector<int> leftHeights;
+    Node<Key, Value>* prev = root->getParent();
+    Node<Key, Value>* curr = root;
+    int height = 0; // height of the subtree finished last
+
+    while (true) {
+        Node<Key, Value>* left = curr->getLeft();
+        Node<Key, Value>* right = curr->getRight();
+
+        if (prev == curr->getParent()) {
+            // first visit; a lone child with children of its own is already
+            // two levels deeper than the empty side
+            Node<Key, Value>* only = (left == nullptr) ? right : (right == nullptr ? left : nullptr);
+            if (only != nullptr && (only->getLeft() != nullptr || only->getRight() != nullptr)) return -1;
+            if (left != nullptr || right != nullptr) {
+                if (left == nullptr) leftHeights.push_back(0);
+                prev = curr;
+                curr = (left != nullptr) ? left : right;
+                continue;
+            }
+            height = 1;
+        }
+        else if (prev == left && right != nullptr) {
+            // left subtree done, walk the right one
+            leftHeights.push_back(height);
+            prev = curr;
+            curr = right;
+            continue;
+        }
+        else if (prev == left) {
+            height += 1; // only child, checked on the way down
+        }
+        else {
+            int leftHeight = leftHeights.back();
+            leftHeights.pop_back();
+            if (std::abs(leftHeight - height) > 1) return -1;
+            height = 1 + std::max(leftHeight, height);
+        }
 
-    if (std::abs(left - right) > 1) return -1;
-    
-    return 1 + std::max(left, right);
+        if (curr == root) return height;
+        prev = curr;
+        curr = curr->getParent();
+    }
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
     return getHeightIfBalanced(root_) != -1;
 }
 
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -764,12 +2262,18 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
     else if(this->root_ == n2) {
         this->root_ = n1;
     }
+    if(this->largest_ == n1) {
+        this->largest_ = n2;
+    }
+    else if(this->largest_ == n2) {
+        this->largest_ = n1;
+    }
 
 }
 
 // SUCCESSOR FUNCTION
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current) {
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* current) {
     if (current == nullptr) return nullptr;
 
     // If right child exists, successor is the left most node of the right subtree
@@ -795,6 +2299,42 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* curr
     return parent;
 }
 
+/**
+* Returns the ThreadLinks of a node in a threaded tree.
+*/
+template<class Key, class Value, class Compare>
+ThreadLinks<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::threadLinks(const Node<Key, Value>* node) const
+{
+    return reinterpret_cast<ThreadLinks<Key, Value>*>(
+        reinterpret_cast<char*>(const_cast<Node<Key, Value>*>(node)) + threadOffset_);
+}
+
+/**
+* In-order successor as the iterators see it: one load through the
+* thread in a threaded tree, successor() otherwise.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::nextNode(const Node<Key, Value>* node) const
+{
+    if (threadOffset_ != 0) {
+        return threadLinks(node)->next;
+    }
+    return successor(const_cast<Node<Key, Value>*>(node));
+}
+
+/**
+* In-order predecessor, the mirror of nextNode().
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::prevNode(const Node<Key, Value>* node) const
+{
+    if (threadOffset_ != 0) {
+        return threadLinks(node)->prev;
+    }
+    return predecessor(const_cast<Node<Key, Value>*>(node));
+}
+
 /**
  * Lastly, we are providing you with a print function,
    BinarySearchTree::printRoot().
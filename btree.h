@@ -0,0 +1,1214 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "node_pool.h"
+
+/**
+* An ordered map kept in a B+ tree, with the insert/remove/find/
+* operator[]/iterator interface of BinarySearchTree so that code can
+* switch between the two by changing a type. Every node is about
+* NodeBytes long and starts on a cache line. Leaves hold up to
+* LEAF_SLOTS items in key order and are linked to their neighbours for
+* iteration; inner nodes hold only separator keys and child pointers. A
+* lookup visits log_B n nodes with a binary search inside each, where a
+* binary tree takes a cache miss for every comparison.
+*
+* Items move between leaves when one splits, merges or lends to its
+* neighbour, so unlike the node-based trees, insert() and remove()
+* invalidate every iterator and reference into the map.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>, std::size_t NodeBytes = 256>
+class BTreeMap
+{
+    static_assert(NodeBytes >= 64, "a B-tree node needs room for a few keys");
+
+    struct NodeBase;
+    struct LeafNode;
+    struct InnerNode;
+
+public:
+    typedef std::pair<const Key, Value> value_type;
+    class const_iterator;
+
+    BTreeMap();
+    explicit BTreeMap(const Compare& comp);
+    BTreeMap(const BTreeMap& other);
+    BTreeMap(BTreeMap&& other) noexcept;
+    BTreeMap& operator=(const BTreeMap& other);
+    BTreeMap& operator=(BTreeMap&& other) noexcept;
+    ~BTreeMap();
+    void swap(BTreeMap& other);
+    void insert(const value_type& keyValuePair);
+    void insert(value_type&& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    // checks the B-tree invariants: every leaf at the same depth, every
+    // node but the root and the last leaf at least half full, keys in
+    // order
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    std::size_t bytesReserved() const;
+    Compare key_comp() const;
+
+    /**
+    * A bidirectional iterator: a leaf and a slot in it. The tree pointer
+    * lets end() be decremented to the last item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    private:
+        friend class BTreeMap<Key, Value, Compare, NodeBytes>;
+        friend class const_iterator;
+        iterator(LeafNode* leaf, unsigned index, const BTreeMap* tree);
+        LeafNode* leaf_;
+        unsigned index_;
+        const BTreeMap* tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator; any iterator converts to one.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        friend class BTreeMap<Key, Value, Compare, NodeBytes>;
+        const LeafNode* leaf_;
+        unsigned index_;
+        const BTreeMap* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    iterator begin() const;
+    iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type ItemSlot;
+    typedef typename std::aligned_storage<sizeof(Key), alignof(Key)>::type KeySlot;
+
+    // Capacities are what fits in NodeBytes after the header, less one
+    // spare slot: a node takes its overflowing item or key first and is
+    // split afterwards. No node holds fewer than four.
+    static const unsigned CACHE_LINE = 64;
+    static const std::size_t LEAF_ROOM = (NodeBytes - 3 * sizeof(void*)) / sizeof(value_type);
+    static const unsigned LEAF_SLOTS = LEAF_ROOM > 5 ? unsigned(LEAF_ROOM - 1) : 4;
+    static const unsigned LEAF_MIN = LEAF_SLOTS / 2;
+    static const std::size_t INNER_ROOM = (NodeBytes - 3 * sizeof(void*)) / (sizeof(Key) + sizeof(void*));
+    static const unsigned INNER_KEYS = INNER_ROOM > 5 ? unsigned(INNER_ROOM - 1) : 4;
+    static const unsigned INNER_MIN = INNER_KEYS / 2;
+
+    struct NodeBase {
+        unsigned count;     // items in a leaf, keys in an inner node
+        bool leaf;
+    };
+    struct LeafNode : NodeBase {
+        value_type& item(unsigned i) { return *reinterpret_cast<value_type*>(&items[i]); }
+        const value_type& item(unsigned i) const { return *reinterpret_cast<const value_type*>(&items[i]); }
+
+        LeafNode* prev;
+        LeafNode* next;
+        ItemSlot items[LEAF_SLOTS + 1];
+    };
+    // children[i] holds the keys before keys[i]; children[count] the rest
+    struct InnerNode : NodeBase {
+        Key& key(unsigned i) { return *reinterpret_cast<Key*>(&keys[i]); }
+        const Key& key(unsigned i) const { return *reinterpret_cast<const Key*>(&keys[i]); }
+
+        KeySlot keys[INNER_KEYS + 1];
+        NodeBase* children[INNER_KEYS + 2];
+    };
+
+    template<typename T, typename Slot>
+    static T& slotAt(Slot* slots, unsigned i) { return *reinterpret_cast<T*>(&slots[i]); }
+    template<typename T, typename Slot>
+    static void shiftUp(Slot* slots, unsigned pos, unsigned count);
+    template<typename T, typename Slot>
+    static void shiftDown(Slot* slots, unsigned pos, unsigned count);
+    template<typename T, typename Slot>
+    static void moveSlots(Slot* dst, Slot* src, unsigned n);
+    template<typename K>
+    static void replaceKey(InnerNode* inner, unsigned i, K&& key);
+
+    LeafNode* newLeaf();
+    InnerNode* newInner();
+    void deleteLeaf(LeafNode* leaf);
+    void deleteInner(InnerNode* inner);
+    void destroyTree(NodeBase* node);
+    NodeBase* cloneTree(const NodeBase* src, LeafNode*& prevLeaf);
+
+    unsigned leafLowerBound(const LeafNode* leaf, const Key& key) const;
+    unsigned leafUpperBound(const LeafNode* leaf, const Key& key) const;
+    unsigned innerUpperBound(const InnerNode* inner, const Key& key) const;
+    LeafNode* findLeaf(const Key& key) const;
+    iterator makeIterator(LeafNode* leaf, unsigned index) const;
+
+    template<typename Pair>
+    void insertItem(Pair&& keyValuePair);
+    template<typename Pair>
+    NodeBase* insertAt(NodeBase* node, Pair&& keyValuePair, KeySlot& up);
+    LeafNode* splitLeaf(LeafNode* leaf, unsigned pos);
+    InnerNode* splitInner(InnerNode* inner, KeySlot& up);
+    bool removeAt(NodeBase* node, const Key& key);
+    void fixChild(InnerNode* parent, unsigned i);
+    void mergeLeaves(InnerNode* parent, unsigned i);
+    void mergeInners(InnerNode* parent, unsigned i);
+    static void removeSeparator(InnerNode* parent, unsigned i);
+
+    static void stepForward(const LeafNode*& leaf, unsigned& index);
+    void stepBack(const LeafNode*& leaf, unsigned& index) const;
+    bool checkNode(const NodeBase* node, const Key* lo, const Key* hi, int depth,
+        int& leafDepth, const LeafNode*& prevLeaf, std::size_t& items) const;
+
+    NodeBase* root_;
+    LeafNode* first_;
+    LeafNode* last_;
+    std::size_t size_;
+    Compare comp_;
+    NodePool leafPool_;
+    NodePool innerPool_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the iterator class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::iterator(LeafNode* leaf, unsigned index, const BTreeMap* tree)
+    : leaf_(leaf), index_(index), tree_(tree)
+{
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::iterator()
+    : leaf_(NULL), index_(0), tree_(NULL)
+{
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+std::pair<const Key,Value>&
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator*() const
+{
+    return leaf_->item(index_);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+std::pair<const Key,Value>*
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator->() const
+{
+    return &(leaf_->item(index_));
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator&
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator++()
+{
+    const LeafNode* leaf = leaf_;
+    stepForward(leaf, index_);
+    leaf_ = const_cast<LeafNode*>(leaf);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator&
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator--()
+{
+    const LeafNode* leaf = leaf_;
+    tree_->stepBack(leaf, index_);
+    leaf_ = const_cast<LeafNode*>(leaf);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the iterator class.
+  -------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the const_iterator class.
+  ---------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::const_iterator()
+    : leaf_(NULL), index_(0), tree_(NULL)
+{
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::const_iterator(const iterator& it)
+    : leaf_(it.leaf_), index_(it.index_), tree_(it.tree_)
+{
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+const std::pair<const Key,Value>&
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator*() const
+{
+    return leaf_->item(index_);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+const std::pair<const Key,Value>*
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator->() const
+{
+    return &(leaf_->item(index_));
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator&
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator++()
+{
+    stepForward(leaf_, index_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator&
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator--()
+{
+    tree_->stepBack(leaf_, index_);
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the const_iterator class.
+  -------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BTreeMap class.
+  ---------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::BTreeMap()
+    : root_(NULL), first_(NULL), last_(NULL), size_(0), comp_(),
+      leafPool_(sizeof(LeafNode), CACHE_LINE), innerPool_(sizeof(InnerNode), CACHE_LINE)
+{
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::BTreeMap(const Compare& comp)
+    : root_(NULL), first_(NULL), last_(NULL), size_(0), comp_(comp),
+      leafPool_(sizeof(LeafNode), CACHE_LINE), innerPool_(sizeof(InnerNode), CACHE_LINE)
+{
+}
+
+/**
+* Copies node for node, relinking the leaves as they are cloned left to
+* right.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::BTreeMap(const BTreeMap& other)
+    : root_(NULL), first_(NULL), last_(NULL), size_(0), comp_(other.comp_),
+      leafPool_(sizeof(LeafNode), CACHE_LINE), innerPool_(sizeof(InnerNode), CACHE_LINE)
+{
+    if (other.root_ == NULL) return;
+    LeafNode* prevLeaf = NULL;
+    try {
+        root_ = cloneTree(other.root_, prevLeaf);
+    }
+    catch (...) {
+        clear();
+        throw;
+    }
+    last_ = prevLeaf;
+    size_ = other.size_;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::BTreeMap(BTreeMap&& other) noexcept
+    : root_(NULL), first_(NULL), last_(NULL), size_(0), comp_(other.comp_),
+      leafPool_(sizeof(LeafNode), CACHE_LINE), innerPool_(sizeof(InnerNode), CACHE_LINE)
+{
+    swap(other);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>&
+BTreeMap<Key, Value, Compare, NodeBytes>::operator=(const BTreeMap& other)
+{
+    if (this != &other) {
+        BTreeMap copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>&
+BTreeMap<Key, Value, Compare, NodeBytes>::operator=(BTreeMap&& other) noexcept
+{
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+BTreeMap<Key, Value, Compare, NodeBytes>::~BTreeMap()
+{
+    clear();
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::swap(BTreeMap& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(first_, other.first_);
+    std::swap(last_, other.last_);
+    std::swap(size_, other.size_);
+    std::swap(comp_, other.comp_);
+    leafPool_.swap(other.leafPool_);
+    innerPool_.swap(other.innerPool_);
+}
+
+/**
+* Adds the item, or overwrites the value if the key is already present.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::insert(const value_type& keyValuePair)
+{
+    insertItem(keyValuePair);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::insert(value_type&& keyValuePair)
+{
+    insertItem(std::move(keyValuePair));
+}
+
+/**
+* Removes the item with this key, if there is one. A leaf left less than
+* half full borrows from a neighbour or merges with it, which can carry
+* up to the root; the tree loses a level when the root runs out of keys.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::remove(const Key& key)
+{
+    if (root_ == NULL) return;
+    removeAt(root_, key);
+    if (root_->count > 0) return;
+    if (root_->leaf) {
+        deleteLeaf(static_cast<LeafNode*>(root_));
+        root_ = first_ = last_ = NULL;
+    }
+    else {
+        InnerNode* oldRoot = static_cast<InnerNode*>(root_);
+        root_ = oldRoot->children[0];
+        deleteInner(oldRoot);
+    }
+}
+
+/**
+* Destroys every item and hands the pools' blocks back at once. Items
+* and keys that need no destructor are not visited at all.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::clear()
+{
+    if (!(std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value)) {
+        destroyTree(root_);
+    }
+    leafPool_.release();
+    innerPool_.release();
+    root_ = first_ = last_ = NULL;
+    size_ = 0;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::isBalanced() const
+{
+    if (root_ == NULL) return size_ == 0;
+    int leafDepth = -1;
+    const LeafNode* prevLeaf = NULL;
+    std::size_t items = 0;
+    return checkNode(root_, NULL, NULL, 0, leafDepth, prevLeaf, items)
+        && prevLeaf == last_ && items == size_;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+std::size_t BTreeMap<Key, Value, Compare, NodeBytes>::size() const
+{
+    return size_;
+}
+
+/**
+ * Returns the number of bytes the node pools currently hold
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+std::size_t BTreeMap<Key, Value, Compare, NodeBytes>::bytesReserved() const
+{
+    return leafPool_.bytesReserved() + innerPool_.bytesReserved();
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+Compare BTreeMap<Key, Value, Compare, NodeBytes>::key_comp() const
+{
+    return comp_;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::begin() const
+{
+    return makeIterator(first_, 0);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::end() const
+{
+    return makeIterator(NULL, 0);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::cbegin() const
+{
+    return begin();
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::cend() const
+{
+    return end();
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::reverse_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::reverse_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_reverse_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::const_reverse_iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::find(const Key& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if (leaf == NULL) return end();
+    unsigned pos = leafLowerBound(leaf, key);
+    if (pos == leaf->count || comp_(key, leaf->item(pos).first)) return end();
+    return makeIterator(leaf, pos);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::lower_bound(const Key& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if (leaf == NULL) return end();
+    unsigned pos = leafLowerBound(leaf, key);
+    if (pos == leaf->count) return makeIterator(leaf->next, 0);
+    return makeIterator(leaf, pos);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::upper_bound(const Key& key) const
+{
+    LeafNode* leaf = findLeaf(key);
+    if (leaf == NULL) return end();
+    unsigned pos = leafUpperBound(leaf, key);
+    if (pos == leaf->count) return makeIterator(leaf->next, 0);
+    return makeIterator(leaf, pos);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+Value& BTreeMap<Key, Value, Compare, NodeBytes>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+Value const & BTreeMap<Key, Value, Compare, NodeBytes>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Opens a gap at pos among the count live slots by moving the ones from
+* pos on up by one.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename T, typename Slot>
+void BTreeMap<Key, Value, Compare, NodeBytes>::shiftUp(Slot* slots, unsigned pos, unsigned count)
+{
+    for (unsigned i = count; i > pos; i--) {
+        new (&slots[i]) T(std::move(slotAt<T>(slots, i - 1)));
+        slotAt<T>(slots, i - 1).~T();
+    }
+}
+
+/**
+* Closes the gap at pos, an empty slot among count, by moving the slots
+* after it down by one.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename T, typename Slot>
+void BTreeMap<Key, Value, Compare, NodeBytes>::shiftDown(Slot* slots, unsigned pos, unsigned count)
+{
+    for (unsigned i = pos; i + 1 < count; i++) {
+        new (&slots[i]) T(std::move(slotAt<T>(slots, i + 1)));
+        slotAt<T>(slots, i + 1).~T();
+    }
+}
+
+/**
+* Moves n live slots into empty storage, leaving the source slots empty.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename T, typename Slot>
+void BTreeMap<Key, Value, Compare, NodeBytes>::moveSlots(Slot* dst, Slot* src, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        new (&dst[i]) T(std::move(slotAt<T>(src, i)));
+        slotAt<T>(src, i).~T();
+    }
+}
+
+/**
+* Separators are rebuilt rather than assigned, so Key only has to be
+* copy or move constructible.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename K>
+void BTreeMap<Key, Value, Compare, NodeBytes>::replaceKey(InnerNode* inner, unsigned i, K&& key)
+{
+    inner->key(i).~Key();
+    new (&inner->keys[i]) Key(std::forward<K>(key));
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::LeafNode*
+BTreeMap<Key, Value, Compare, NodeBytes>::newLeaf()
+{
+    LeafNode* leaf = new (leafPool_.allocate()) LeafNode;
+    leaf->count = 0;
+    leaf->leaf = true;
+    leaf->prev = leaf->next = NULL;
+    return leaf;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::InnerNode*
+BTreeMap<Key, Value, Compare, NodeBytes>::newInner()
+{
+    InnerNode* inner = new (innerPool_.allocate()) InnerNode;
+    inner->count = 0;
+    inner->leaf = false;
+    return inner;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::deleteLeaf(LeafNode* leaf)
+{
+    for (unsigned i = 0; i < leaf->count; i++) {
+        leaf->item(i).~value_type();
+    }
+    leafPool_.deallocate(leaf);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::deleteInner(InnerNode* inner)
+{
+    for (unsigned i = 0; i < inner->count; i++) {
+        inner->key(i).~Key();
+    }
+    innerPool_.deallocate(inner);
+}
+
+/**
+* Runs the destructors of every item and key below node; the storage
+* itself goes back with the pools.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::destroyTree(NodeBase* node)
+{
+    if (node == NULL) return;
+    if (node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        for (unsigned i = 0; i < leaf->count; i++) {
+            leaf->item(i).~value_type();
+        }
+        return;
+    }
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    for (unsigned i = 0; i <= inner->count; i++) {
+        destroyTree(inner->children[i]);
+    }
+    for (unsigned i = 0; i < inner->count; i++) {
+        inner->key(i).~Key();
+    }
+}
+
+/**
+* Clones src and everything below it. prevLeaf is the last leaf cloned
+* so far; each new leaf is linked after it. If a copy throws, the nodes
+* built so far are complete and reachable, so clear() can undo them.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::NodeBase*
+BTreeMap<Key, Value, Compare, NodeBytes>::cloneTree(const NodeBase* src, LeafNode*& prevLeaf)
+{
+    if (src->leaf) {
+        const LeafNode* from = static_cast<const LeafNode*>(src);
+        LeafNode* leaf = newLeaf();
+        leaf->prev = prevLeaf;
+        if (prevLeaf != NULL) prevLeaf->next = leaf;
+        else first_ = leaf;
+        prevLeaf = leaf;
+        if (root_ == NULL) root_ = leaf;
+        for (unsigned i = 0; i < from->count; i++) {
+            new (&leaf->items[i]) value_type(from->item(i));
+            leaf->count++;
+        }
+        return leaf;
+    }
+    const InnerNode* from = static_cast<const InnerNode*>(src);
+    InnerNode* inner = newInner();
+    if (root_ == NULL) root_ = inner;
+    inner->children[0] = cloneTree(from->children[0], prevLeaf);
+    for (unsigned i = 0; i < from->count; i++) {
+        new (&inner->keys[i]) Key(from->key(i));
+        inner->children[i + 1] = cloneTree(from->children[i + 1], prevLeaf);
+        inner->count++;
+    }
+    return inner;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+unsigned BTreeMap<Key, Value, Compare, NodeBytes>::leafLowerBound(const LeafNode* leaf, const Key& key) const
+{
+    unsigned lo = 0, hi = leaf->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (comp_(leaf->item(mid).first, key)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+unsigned BTreeMap<Key, Value, Compare, NodeBytes>::leafUpperBound(const LeafNode* leaf, const Key& key) const
+{
+    unsigned lo = 0, hi = leaf->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (comp_(key, leaf->item(mid).first)) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+* The child to descend into: the number of separators not after key,
+* since a separator is the smallest key of the subtree to its right.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+unsigned BTreeMap<Key, Value, Compare, NodeBytes>::innerUpperBound(const InnerNode* inner, const Key& key) const
+{
+    unsigned lo = 0, hi = inner->count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (comp_(key, inner->key(mid))) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+/**
+* The leaf whose range holds key, or NULL for an empty map.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::LeafNode*
+BTreeMap<Key, Value, Compare, NodeBytes>::findLeaf(const Key& key) const
+{
+    NodeBase* node = root_;
+    if (node == NULL) return NULL;
+    while (!node->leaf) {
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        node = inner->children[innerUpperBound(inner, key)];
+    }
+    return static_cast<LeafNode*>(node);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::iterator
+BTreeMap<Key, Value, Compare, NodeBytes>::makeIterator(LeafNode* leaf, unsigned index) const
+{
+    return iterator(leaf, index, this);
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename Pair>
+void BTreeMap<Key, Value, Compare, NodeBytes>::insertItem(Pair&& keyValuePair)
+{
+    if (root_ == NULL) {
+        root_ = first_ = last_ = newLeaf();
+    }
+    KeySlot up;
+    NodeBase* split = insertAt(root_, std::forward<Pair>(keyValuePair), up);
+    if (split == NULL) return;
+    InnerNode* root = newInner();
+    new (&root->keys[0]) Key(std::move(slotAt<Key>(&up, 0)));
+    slotAt<Key>(&up, 0).~Key();
+    root->children[0] = root_;
+    root->children[1] = split;
+    root->count = 1;
+    root_ = root;
+}
+
+/**
+* Inserts below node. If node overflows it is split; the new right half
+* is returned and its separator constructed in up. Otherwise returns
+* NULL.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+template<typename Pair>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::NodeBase*
+BTreeMap<Key, Value, Compare, NodeBytes>::insertAt(NodeBase* node, Pair&& keyValuePair, KeySlot& up)
+{
+    if (node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        unsigned pos = leafLowerBound(leaf, keyValuePair.first);
+        if (pos < leaf->count && !comp_(keyValuePair.first, leaf->item(pos).first)) {
+            leaf->item(pos).second = std::forward<Pair>(keyValuePair).second;
+            return NULL;
+        }
+        shiftUp<value_type>(leaf->items, pos, leaf->count);
+        new (&leaf->items[pos]) value_type(std::forward<Pair>(keyValuePair));
+        leaf->count++;
+        size_++;
+        if (leaf->count <= LEAF_SLOTS) return NULL;
+        LeafNode* right = splitLeaf(leaf, pos);
+        new (&up) Key(right->item(0).first);
+        return right;
+    }
+
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    unsigned i = innerUpperBound(inner, keyValuePair.first);
+    KeySlot childUp;
+    NodeBase* split = insertAt(inner->children[i], std::forward<Pair>(keyValuePair), childUp);
+    if (split == NULL) return NULL;
+    shiftUp<Key>(inner->keys, i, inner->count);
+    new (&inner->keys[i]) Key(std::move(slotAt<Key>(&childUp, 0)));
+    slotAt<Key>(&childUp, 0).~Key();
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count + 1,
+        inner->children + inner->count + 2);
+    inner->children[i + 1] = split;
+    inner->count++;
+    if (inner->count <= INNER_KEYS) return NULL;
+    return splitInner(inner, up);
+}
+
+/**
+* Moves the upper half of an overfull leaf into a new leaf linked after
+* it. An item appended to the last leaf goes on its own instead, so keys
+* that arrive in order fill their leaves rather than leaving them half
+* empty.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::LeafNode*
+BTreeMap<Key, Value, Compare, NodeBytes>::splitLeaf(LeafNode* leaf, unsigned pos)
+{
+    LeafNode* right = newLeaf();
+    unsigned mid = (leaf->next == NULL && pos + 1 == leaf->count) ? leaf->count - 1 : leaf->count / 2;
+    moveSlots<value_type>(right->items, leaf->items + mid, leaf->count - mid);
+    right->count = leaf->count - mid;
+    leaf->count = mid;
+
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != NULL) leaf->next->prev = right;
+    else last_ = right;
+    leaf->next = right;
+    return right;
+}
+
+/**
+* Splits an overfull inner node around its middle key, which moves up
+* into up rather than staying in either half.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+typename BTreeMap<Key, Value, Compare, NodeBytes>::InnerNode*
+BTreeMap<Key, Value, Compare, NodeBytes>::splitInner(InnerNode* inner, KeySlot& up)
+{
+    InnerNode* right = newInner();
+    unsigned mid = inner->count / 2;
+    unsigned moved = inner->count - mid - 1;
+    moveSlots<Key>(right->keys, inner->keys + mid + 1, moved);
+    std::copy(inner->children + mid + 1, inner->children + inner->count + 1, right->children);
+    new (&up) Key(std::move(inner->key(mid)));
+    inner->key(mid).~Key();
+    right->count = moved;
+    inner->count = mid;
+    return right;
+}
+
+/**
+* Removes key from below node and returns whether node is now less than
+* half full. Separators are left alone: one that no longer matches a key
+* still divides its children correctly.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::removeAt(NodeBase* node, const Key& key)
+{
+    if (node->leaf) {
+        LeafNode* leaf = static_cast<LeafNode*>(node);
+        unsigned pos = leafLowerBound(leaf, key);
+        if (pos == leaf->count || comp_(key, leaf->item(pos).first)) return false;
+        leaf->item(pos).~value_type();
+        shiftDown<value_type>(leaf->items, pos, leaf->count);
+        leaf->count--;
+        size_--;
+        return leaf->count < LEAF_MIN;
+    }
+    InnerNode* inner = static_cast<InnerNode*>(node);
+    unsigned i = innerUpperBound(inner, key);
+    if (!removeAt(inner->children[i], key)) return false;
+    fixChild(inner, i);
+    return inner->count < INNER_MIN;
+}
+
+/**
+* Refills parent's child i, which is less than half full: it takes one
+* entry from a neighbour that can spare it, rotating through the
+* separator between them, or else merges with a neighbour.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::fixChild(InnerNode* parent, unsigned i)
+{
+    if (parent->children[i]->leaf) {
+        LeafNode* child = static_cast<LeafNode*>(parent->children[i]);
+        LeafNode* left = i > 0 ? static_cast<LeafNode*>(parent->children[i - 1]) : NULL;
+        LeafNode* right = i < parent->count ? static_cast<LeafNode*>(parent->children[i + 1]) : NULL;
+        if (left != NULL && left->count > LEAF_MIN) {
+            shiftUp<value_type>(child->items, 0, child->count);
+            moveSlots<value_type>(child->items, left->items + left->count - 1, 1);
+            left->count--;
+            child->count++;
+            replaceKey(parent, i - 1, child->item(0).first);
+        }
+        else if (right != NULL && right->count > LEAF_MIN) {
+            moveSlots<value_type>(child->items + child->count, right->items, 1);
+            shiftDown<value_type>(right->items, 0, right->count);
+            right->count--;
+            child->count++;
+            replaceKey(parent, i, right->item(0).first);
+        }
+        else {
+            mergeLeaves(parent, left != NULL ? i - 1 : i);
+        }
+        return;
+    }
+
+    InnerNode* child = static_cast<InnerNode*>(parent->children[i]);
+    InnerNode* left = i > 0 ? static_cast<InnerNode*>(parent->children[i - 1]) : NULL;
+    InnerNode* right = i < parent->count ? static_cast<InnerNode*>(parent->children[i + 1]) : NULL;
+    if (left != NULL && left->count > INNER_MIN) {
+        shiftUp<Key>(child->keys, 0, child->count);
+        std::copy_backward(child->children, child->children + child->count + 1,
+            child->children + child->count + 2);
+        new (&child->keys[0]) Key(std::move(parent->key(i - 1)));
+        child->children[0] = left->children[left->count];
+        child->count++;
+        replaceKey(parent, i - 1, std::move(left->key(left->count - 1)));
+        left->key(left->count - 1).~Key();
+        left->count--;
+    }
+    else if (right != NULL && right->count > INNER_MIN) {
+        new (&child->keys[child->count]) Key(std::move(parent->key(i)));
+        child->children[child->count + 1] = right->children[0];
+        child->count++;
+        replaceKey(parent, i, std::move(right->key(0)));
+        right->key(0).~Key();
+        shiftDown<Key>(right->keys, 0, right->count);
+        std::copy(right->children + 1, right->children + right->count + 1, right->children);
+        right->count--;
+    }
+    else {
+        mergeInners(parent, left != NULL ? i - 1 : i);
+    }
+}
+
+/**
+* Moves every item of parent's child i + 1 into child i and drops the
+* emptied leaf and its separator.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::mergeLeaves(InnerNode* parent, unsigned i)
+{
+    LeafNode* left = static_cast<LeafNode*>(parent->children[i]);
+    LeafNode* right = static_cast<LeafNode*>(parent->children[i + 1]);
+    moveSlots<value_type>(left->items + left->count, right->items, right->count);
+    left->count += right->count;
+    right->count = 0;
+    left->next = right->next;
+    if (right->next != NULL) right->next->prev = left;
+    else last_ = left;
+    deleteLeaf(right);
+    removeSeparator(parent, i);
+}
+
+/**
+* Pulls separator i down between the keys of parent's children i and
+* i + 1 and moves all of child i + 1 into child i.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::mergeInners(InnerNode* parent, unsigned i)
+{
+    InnerNode* left = static_cast<InnerNode*>(parent->children[i]);
+    InnerNode* right = static_cast<InnerNode*>(parent->children[i + 1]);
+    new (&left->keys[left->count]) Key(std::move(parent->key(i)));
+    moveSlots<Key>(left->keys + left->count + 1, right->keys, right->count);
+    std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+    left->count += right->count + 1;
+    right->count = 0;
+    deleteInner(right);
+    removeSeparator(parent, i);
+}
+
+/**
+* Drops separator i and child i + 1 from parent.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::removeSeparator(InnerNode* parent, unsigned i)
+{
+    parent->key(i).~Key();
+    shiftDown<Key>(parent->keys, i, parent->count);
+    std::copy(parent->children + i + 2, parent->children + parent->count + 1, parent->children + i + 1);
+    parent->count--;
+}
+
+/**
+* Leaves are never empty, so stepping off the end of one lands on the
+* first item of the next, or on end() after the last.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::stepForward(const LeafNode*& leaf, unsigned& index)
+{
+    if (++index < leaf->count) return;
+    leaf = leaf->next;
+    index = 0;
+}
+
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+void BTreeMap<Key, Value, Compare, NodeBytes>::stepBack(const LeafNode*& leaf, unsigned& index) const
+{
+    if (leaf == NULL) leaf = last_;
+    else if (index == 0) leaf = leaf->prev;
+    else {
+        index--;
+        return;
+    }
+    index = leaf->count - 1;
+}
+
+/**
+* Checks the subtree at node, whose keys must lie in [lo, hi) (NULL for
+* no bound), and counts its items. Leaves must all sit at the same depth
+* and be linked in order. The last leaf may be short: appends split it
+* off with a single item.
+*/
+template<class Key, class Value, class Compare, std::size_t NodeBytes>
+bool BTreeMap<Key, Value, Compare, NodeBytes>::checkNode(const NodeBase* node, const Key* lo, const Key* hi,
+    int depth, int& leafDepth, const LeafNode*& prevLeaf, std::size_t& items) const
+{
+    if (node->leaf) {
+        const LeafNode* leaf = static_cast<const LeafNode*>(node);
+        if (node != root_ && node != last_ && leaf->count < LEAF_MIN) return false;
+        if (leafDepth < 0) leafDepth = depth;
+        if (depth != leafDepth || leaf->prev != prevLeaf) return false;
+        if (prevLeaf == NULL ? first_ != leaf : prevLeaf->next != leaf) return false;
+        for (unsigned i = 0; i < leaf->count; i++) {
+            const Key& key = leaf->item(i).first;
+            if (lo != NULL && comp_(key, *lo)) return false;
+            if (hi != NULL && !comp_(key, *hi)) return false;
+            if (i > 0 && !comp_(leaf->item(i - 1).first, key)) return false;
+        }
+        prevLeaf = leaf;
+        items += leaf->count;
+        return leaf->count > 0 || node == root_;
+    }
+    const InnerNode* inner = static_cast<const InnerNode*>(node);
+    if (inner->count == 0 || (node != root_ && inner->count < INNER_MIN)) return false;
+    for (unsigned i = 0; i <= inner->count; i++) {
+        const Key* childLo = i == 0 ? lo : &inner->key(i - 1);
+        const Key* childHi = i == inner->count ? hi : &inner->key(i);
+        if (childLo != NULL && childHi != NULL && !comp_(*childLo, *childHi)) return false;
+        if (!checkNode(inner->children[i], childLo, childHi, depth + 1, leafDepth, prevLeaf, items)) return false;
+    }
+    return true;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the BTreeMap class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,918 @@
+#ifndef CONCURRENT_AVLBST_H
+#define CONCURRENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "epoch.h"
+
+/**
+* An AVL tree that many threads can read and update at once, after
+* Bronson, Casper, Chafi and Olukotun, "A Practical Concurrent Binary
+* Search Tree" (PPoPP 2010).
+*
+* Readers take no locks. Each node carries a version that a writer bumps
+* whenever a rotation shrinks the key range below that node. A reader
+* checks that the version of the node it is standing on has not changed
+* before trusting the child pointer it read, and steps back up and
+* retries if it has. Writers lock just the nodes they change: the parent
+* of an inserted or unlinked node, and the two or three nodes of a
+* rotation. Locks are always taken top-down, so they cannot deadlock.
+*
+* Balance is relaxed: heights are repaired on the way up after each
+* update, as insertFix/removeFix do in AVLTree, but concurrent writers may
+* leave the tree briefly out of balance until the last repair finishes.
+* A key with two children is removed by clearing its value, which turns
+* the node into a routing node; a later repair unlinks it once it has at
+* most one child. Unlinked nodes and replaced values are freed through
+* EpochReclaimer once no reader can still see them.
+*
+* Values are kept behind a pointer so they can be replaced atomically,
+* which is why find() and operator[] return copies. Values must be copy
+* constructible; nothing else is required of Key, Value or Compare
+* beyond what AVLTree needs.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    explicit ConcurrentAVLTree(const Compare& comp = Compare());
+    ~ConcurrentAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    bool empty() const;
+
+    // Not safe to call while other threads use the tree.
+    std::size_t size() const;
+    bool isBalanced() const;
+
+private:
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    /**
+    * Everything but the key; the tree's root holder is a bare Link whose
+    * right child is the root. A null value marks a routing node.
+    */
+    struct Link {
+        Link();
+        Link* child(int dir) const { return dir < 0 ? left.load() : right.load(); }
+        void setChild(int dir, Link* node) { if (dir < 0) left.store(node); else right.store(node); }
+
+        // what readers look at first
+        std::atomic<unsigned long> version;
+        std::atomic<Link*> left;
+        std::atomic<Link*> right;
+        std::atomic<const Value*> value;
+        std::atomic<Link*> parent;
+        std::atomic<int> height;
+        std::atomic<bool> locked;
+    };
+    struct KeyedLink : Link {
+        explicit KeyedLink(const Key& k) : key(k) { this->height.store(1); }
+        const Key key;
+    };
+    // Holds a node's spin lock for the current scope.
+    class LinkLock {
+    public:
+        explicit LinkLock(Link* node);
+        ~LinkLock() { node_->locked.store(false, std::memory_order_release); }
+    private:
+        LinkLock(const LinkLock&);
+        LinkLock& operator=(const LinkLock&);
+        Link* node_;
+    };
+
+    // Outcome of one optimistic attempt; RETRY restarts it one level up.
+    enum Outcome { RETRY, FOUND, ABSENT };
+
+    // Version bits: the low bit marks an unlinked node, the next one a
+    // rotation in progress, and the rest count finished rotations.
+    static const unsigned long UNLINKED = 1;
+    static const unsigned long SHRINKING = 2;
+    static const unsigned long SHRINK_COUNT = 4;
+
+    // nodeCondition() results other than a new height.
+    static const int NOTHING_REQUIRED = -1;
+    static const int REBALANCE_REQUIRED = -2;
+    static const int UNLINK_REQUIRED = -3;
+
+    static const unsigned SPIN_LIMIT = 100;
+
+    int compareTo(const Key& key, const Link* node) const;
+    static int heightOf(const Link* node) { return node == nullptr ? 0 : node->height.load(); }
+    static bool canUnlink(const Link* node) { return node->left.load() == nullptr || node->right.load() == nullptr; }
+    static void waitUntilNotChanging(Link* node);
+
+    Outcome attemptGet(const Key& key, Link* node, int dir, unsigned long nodeV, const Value*& found) const;
+    Outcome attemptPut(const Key& key, std::unique_ptr<const Value>& value, KeyedLink*& spare,
+        Link* node, int dir, unsigned long nodeV);
+    Outcome attemptInsert(const Key& key, std::unique_ptr<const Value>& value, KeyedLink*& spare,
+        Link* node, int dir, unsigned long nodeV);
+    Outcome attemptUpdate(Link* node, std::unique_ptr<const Value>& value);
+    Outcome attemptRemove(const Key& key, Link* node, int dir, unsigned long nodeV);
+    Outcome attemptRemoveNode(Link* parent, Link* node);
+    static bool attemptUnlink(Link* parent, Link* node);
+
+    static int nodeCondition(Link* node);
+    static void fixHeightAndRebalance(Link* node);
+    static Link* fixHeight(Link* node);
+    static Link* rebalance(Link* parent, Link* node);
+    static Link* rebalanceToRight(Link* parent, Link* node, Link* left, int hR0);
+    static Link* rebalanceToLeft(Link* parent, Link* node, Link* right, int hL0);
+    static Link* rotateRight(Link* parent, Link* node, Link* left, int hR, int hLL, Link* leftRight, int hLR);
+    static Link* rotateLeft(Link* parent, Link* node, int hL, Link* right, Link* rightLeft, int hRL, int hRR);
+    static Link* rotateRightOverLeft(Link* parent, Link* node, Link* left, int hR, int hLL, Link* leftRight, int hLRL);
+    static Link* rotateLeftOverRight(Link* parent, Link* node, int hL, Link* right, Link* rightLeft, int hRR, int hRLR);
+    static Link* finishRotation(Link* parent, Link* top, int oldHeight, Link* damaged);
+    static unsigned long beginChange(unsigned long version) { return version | SHRINKING; }
+    static unsigned long endChange(unsigned long version) { return (version & ~SHRINKING) + SHRINK_COUNT; }
+
+    static void destroyLink(void* node);
+    static void destroyValue(void* value);
+    static int checkBalanced(const Link* node, bool& balanced);
+
+    mutable Link rootHolder_;
+    Compare comp_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::Link::Link() :
+    version(0), left(nullptr), right(nullptr), value(nullptr), parent(nullptr), height(0), locked(false)
+{
+}
+
+/**
+* Spins briefly, then yields, so a preempted lock holder can finish.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::LinkLock::LinkLock(Link* node) : node_(node)
+{
+    unsigned spins = 0;
+    while (node->locked.exchange(true, std::memory_order_acquire)) {
+        while (node->locked.load(std::memory_order_relaxed)) {
+            if (++spins > SPIN_LIMIT) std::this_thread::yield();
+        }
+    }
+}
+
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) : comp_(comp)
+{
+}
+
+/**
+* Frees every node still in the tree. Nodes already unlinked belong to
+* EpochReclaimer and are freed by it.
+*/
+template<class Key, class Value, class Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    std::vector<Link*> pending(1, rootHolder_.right.load());
+    while (!pending.empty()) {
+        Link* node = pending.back();
+        pending.pop_back();
+        if (node == nullptr) continue;
+        pending.push_back(node->left.load());
+        pending.push_back(node->right.load());
+        delete node->value.load();
+        delete static_cast<KeyedLink*>(node);
+    }
+}
+
+/**
+* Inserts the item, or replaces the value of an existing key.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::unique_ptr<const Value> value(new Value(keyValuePair.second));
+    KeyedLink* spare = nullptr;
+    {
+        EpochReclaimer::Guard guard;
+        while (attemptPut(keyValuePair.first, value, spare, &rootHolder_, 1, 0) == RETRY) { }
+    }
+    delete spare;
+}
+
+/**
+* Removes the key if it is present.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    EpochReclaimer::Guard guard;
+    while (attemptRemove(key, &rootHolder_, 1, 0) == RETRY) { }
+}
+
+/**
+* Copies the value stored for key into value; returns false if the key is
+* not present.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    EpochReclaimer::Guard guard;
+    const Value* found = nullptr;
+    Outcome outcome;
+    while ((outcome = attemptGet(key, &rootHolder_, 1, 0, found)) == RETRY) { }
+    if (outcome != FOUND) return false;
+    value = *found;
+    return true;
+}
+
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key& key) const
+{
+    EpochReclaimer::Guard guard;
+    const Value* found = nullptr;
+    Outcome outcome;
+    while ((outcome = attemptGet(key, &rootHolder_, 1, 0, found)) == RETRY) { }
+    return outcome == FOUND;
+}
+
+/**
+* Returns a copy of the value stored for key; throws std::out_of_range if
+* the key is not present.
+*/
+template<class Key, class Value, class Compare>
+Value ConcurrentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    EpochReclaimer::Guard guard;
+    const Value* found = nullptr;
+    Outcome outcome;
+    while ((outcome = attemptGet(key, &rootHolder_, 1, 0, found)) == RETRY) { }
+    if (outcome != FOUND) throw std::out_of_range("Invalid key");
+    return *found;
+}
+
+/**
+* True when no key is present. Routing nodes may remain in a tree whose
+* keys have all been removed, so this walks the tree; it is exact only
+* when no other thread is writing.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    EpochReclaimer::Guard guard;
+    std::vector<const Link*> pending(1, rootHolder_.right.load());
+    while (!pending.empty()) {
+        const Link* node = pending.back();
+        pending.pop_back();
+        if (node == nullptr) continue;
+        if (node->value.load() != nullptr) return false;
+        pending.push_back(node->left.load());
+        pending.push_back(node->right.load());
+    }
+    return true;
+}
+
+template<class Key, class Value, class Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    std::size_t count = 0;
+    std::vector<const Link*> pending(1, rootHolder_.right.load());
+    while (!pending.empty()) {
+        const Link* node = pending.back();
+        pending.pop_back();
+        if (node == nullptr) continue;
+        if (node->value.load() != nullptr) count++;
+        pending.push_back(node->left.load());
+        pending.push_back(node->right.load());
+    }
+    return count;
+}
+
+/**
+* Checks the stored heights and the AVL balance of every node. Once all
+* writers are done every repair has run, so this holds again.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    bool balanced = true;
+    checkBalanced(rootHolder_.right.load(), balanced);
+    return balanced;
+}
+
+template<class Key, class Value, class Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::checkBalanced(const Link* node, bool& balanced)
+{
+    if (node == nullptr) return 0;
+    int hL = checkBalanced(node->left.load(), balanced);
+    int hR = checkBalanced(node->right.load(), balanced);
+    if (hL - hR > 1 || hR - hL > 1 || node->height.load() != 1 + std::max(hL, hR)) balanced = false;
+    return 1 + std::max(hL, hR);
+}
+
+/**
+* -1, 0 or 1 as key sorts before, with or after the node's key.
+*/
+template<class Key, class Value, class Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::compareTo(const Key& key, const Link* node) const
+{
+    const Key& nodeKey = static_cast<const KeyedLink*>(node)->key;
+    if (comp_(key, nodeKey)) return -1;
+    return comp_(nodeKey, key) ? 1 : 0;
+}
+
+/**
+* Waits out a rotation below node. The rotating writer holds node's lock,
+* so taking it ends the wait if spinning does not.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::waitUntilNotChanging(Link* node)
+{
+    unsigned long version = node->version.load();
+    if ((version & SHRINKING) == 0) return;
+    for (unsigned spins = 0; spins < SPIN_LIMIT; spins++) {
+        if (node->version.load() != version) return;
+    }
+    LinkLock wait(node);
+}
+
+/**
+* One step of a lock-free search below node, whose version was nodeV
+* when the caller stepped onto it. Stepping down to a child is only
+* trusted if node's version is still nodeV afterwards; otherwise a
+* rotation may have moved the key out of this subtree.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptGet(const Key& key, Link* node, int dir, unsigned long nodeV,
+    const Value*& found) const
+{
+    for (;;) {
+        Link* child = node->child(dir);
+        if (node->version.load() != nodeV) return RETRY;
+        if (child == nullptr) return ABSENT;
+
+        int nextDir = compareTo(key, child);
+        if (nextDir == 0) {
+            found = child->value.load();
+            return found == nullptr ? ABSENT : FOUND;
+        }
+        unsigned long childV = child->version.load();
+        if ((childV & SHRINKING) != 0) {
+            waitUntilNotChanging(child);
+        }
+        else if (childV != UNLINKED && child == node->child(dir)) {
+            if (node->version.load() != nodeV) return RETRY;
+            Outcome outcome = attemptGet(key, child, nextDir, childV, found);
+            if (outcome != RETRY) return outcome;
+        }
+    }
+}
+
+/**
+* The search of attemptGet(), ending in an update of the key's node or in
+* linking a new leaf below node.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptPut(const Key& key, std::unique_ptr<const Value>& value,
+    KeyedLink*& spare, Link* node, int dir, unsigned long nodeV)
+{
+    Outcome outcome = RETRY;
+    do {
+        Link* child = node->child(dir);
+        if (node->version.load() != nodeV) return RETRY;
+        if (child == nullptr) {
+            outcome = attemptInsert(key, value, spare, node, dir, nodeV);
+        }
+        else {
+            int nextDir = compareTo(key, child);
+            if (nextDir == 0) {
+                outcome = attemptUpdate(child, value);
+            }
+            else {
+                unsigned long childV = child->version.load();
+                if ((childV & SHRINKING) != 0) {
+                    waitUntilNotChanging(child);
+                }
+                else if (childV != UNLINKED && child == node->child(dir)) {
+                    if (node->version.load() != nodeV) return RETRY;
+                    outcome = attemptPut(key, value, spare, child, nextDir, childV);
+                }
+            }
+        }
+    } while (outcome == RETRY);
+    return outcome;
+}
+
+/**
+* Links a new leaf as node's dir child, then repairs heights upwards. The
+* leaf is allocated before taking the lock and kept in spare if the
+* attempt has to be retried.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptInsert(const Key& key, std::unique_ptr<const Value>& value,
+    KeyedLink*& spare, Link* node, int dir, unsigned long nodeV)
+{
+    if (spare == nullptr) spare = new KeyedLink(key);
+    {
+        LinkLock lock(node);
+        if (node->version.load() != nodeV || node->child(dir) != nullptr) return RETRY;
+        spare->parent.store(node);
+        spare->value.store(value.release());
+        node->setChild(dir, spare);
+        spare = nullptr;
+    }
+    fixHeightAndRebalance(node);
+    return FOUND;
+}
+
+/**
+* Replaces the value of an existing node, which revives a routing node.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptUpdate(Link* node, std::unique_ptr<const Value>& value)
+{
+    const Value* previous;
+    {
+        LinkLock lock(node);
+        if (node->version.load() == UNLINKED) return RETRY;
+        previous = node->value.exchange(value.release());
+    }
+    if (previous != nullptr) EpochReclaimer::retire(const_cast<Value*>(previous), &destroyValue);
+    return FOUND;
+}
+
+/**
+* The search of attemptGet(), ending in attemptRemoveNode().
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptRemove(const Key& key, Link* node, int dir, unsigned long nodeV)
+{
+    Outcome outcome = RETRY;
+    do {
+        Link* child = node->child(dir);
+        if (node->version.load() != nodeV) return RETRY;
+        if (child == nullptr) return ABSENT;
+
+        int nextDir = compareTo(key, child);
+        if (nextDir == 0) {
+            outcome = attemptRemoveNode(node, child);
+        }
+        else {
+            unsigned long childV = child->version.load();
+            if ((childV & SHRINKING) != 0) {
+                waitUntilNotChanging(child);
+            }
+            else if (childV != UNLINKED && child == node->child(dir)) {
+                if (node->version.load() != nodeV) return RETRY;
+                outcome = attemptRemove(key, child, nextDir, childV);
+            }
+        }
+    } while (outcome == RETRY);
+    return outcome;
+}
+
+/**
+* Removes node's key. A node with two children only loses its value and
+* stays as a routing node; otherwise it is unlinked under the locks of
+* parent and node, and the heights above are repaired.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Outcome
+ConcurrentAVLTree<Key, Value, Compare>::attemptRemoveNode(Link* parent, Link* node)
+{
+    if (node->value.load() == nullptr) return ABSENT;
+
+    const Value* previous;
+    if (!canUnlink(node)) {
+        LinkLock lock(node);
+        if (node->version.load() == UNLINKED || canUnlink(node)) return RETRY;
+        previous = node->value.exchange(nullptr);
+    }
+    else {
+        {
+            LinkLock parentLock(parent);
+            if (parent->version.load() == UNLINKED || node->parent.load() != parent) return RETRY;
+            LinkLock lock(node);
+            previous = node->value.load();
+            if (previous == nullptr) return ABSENT;
+            if (!attemptUnlink(parent, node)) return RETRY;
+        }
+        fixHeightAndRebalance(parent);
+    }
+    if (previous == nullptr) return ABSENT;
+    EpochReclaimer::retire(const_cast<Value*>(previous), &destroyValue);
+    return FOUND;
+}
+
+/**
+* Splices out node, which has at most one child, and retires it. Both
+* parent and node must be locked.
+*/
+template<class Key, class Value, class Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::attemptUnlink(Link* parent, Link* node)
+{
+    Link* parentLeft = parent->left.load();
+    Link* parentRight = parent->right.load();
+    if (parentLeft != node && parentRight != node) return false;
+
+    Link* left = node->left.load();
+    Link* right = node->right.load();
+    if (left != nullptr && right != nullptr) return false;
+
+    Link* splice = left != nullptr ? left : right;
+    if (parentLeft == node) parent->left.store(splice);
+    else parent->right.store(splice);
+    if (splice != nullptr) splice->parent.store(parent);
+
+    node->version.store(UNLINKED);
+    node->value.store(nullptr);
+    EpochReclaimer::retire(node, &destroyLink);
+    return true;
+}
+
+/**
+* What node needs: UNLINK_REQUIRED for a routing node with a missing
+* child, REBALANCE_REQUIRED if its children's heights differ by more
+* than one, its corrected height if that is wrong, else NOTHING_REQUIRED.
+*/
+template<class Key, class Value, class Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::nodeCondition(Link* node)
+{
+    Link* left = node->left.load();
+    Link* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) return UNLINK_REQUIRED;
+
+    int height = node->height.load();
+    int hL = heightOf(left);
+    int hR = heightOf(right);
+    int repaired = 1 + std::max(hL, hR);
+    if (hL - hR > 1 || hR - hL > 1) return REBALANCE_REQUIRED;
+    return height != repaired ? repaired : NOTHING_REQUIRED;
+}
+
+/**
+* The concurrent counterpart of insertFix/removeFix: walks up from node,
+* fixing heights under node's lock and rotating or unlinking under the
+* locks of node and its parent, until nothing changes.
+*/
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::fixHeightAndRebalance(Link* node)
+{
+    while (node != nullptr && node->parent.load() != nullptr) {
+        int condition = nodeCondition(node);
+        if (condition == NOTHING_REQUIRED || node->version.load() == UNLINKED) return;
+
+        if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+            LinkLock lock(node);
+            node = fixHeight(node);
+        }
+        else {
+            Link* parent = node->parent.load();
+            LinkLock parentLock(parent);
+            if (parent->version.load() != UNLINKED && node->parent.load() == parent) {
+                LinkLock lock(node);
+                node = rebalance(parent, node);
+            }
+        }
+    }
+}
+
+/**
+* Stores node's corrected height; node must be locked. Returns the next
+* node to look at, or null when done.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::fixHeight(Link* node)
+{
+    int condition = nodeCondition(node);
+    switch (condition) {
+    case REBALANCE_REQUIRED:
+    case UNLINK_REQUIRED:
+        return node;
+    case NOTHING_REQUIRED:
+        return nullptr;
+    default:
+        node->height.store(condition);
+        return node->parent.load();
+    }
+}
+
+/**
+* Repairs node with parent and node locked: unlinks a routing node,
+* rotates, or fixes its height. Returns the next node to repair.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rebalance(Link* parent, Link* node)
+{
+    Link* left = node->left.load();
+    Link* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && node->value.load() == nullptr) {
+        return attemptUnlink(parent, node) ? fixHeight(parent) : node;
+    }
+
+    int height = node->height.load();
+    int hL0 = heightOf(left);
+    int hR0 = heightOf(right);
+    int repaired = 1 + std::max(hL0, hR0);
+    int balance = hL0 - hR0;
+    if (balance > 1) return rebalanceToRight(parent, node, left, hR0);
+    if (balance < -1) return rebalanceToLeft(parent, node, right, hL0);
+    if (repaired != height) {
+        node->height.store(repaired);
+        return fixHeight(parent);
+    }
+    return nullptr;
+}
+
+/**
+* node is left-heavy: a single right rotation, or a double one if the
+* left child leans right. Locks the left child (and its right child for
+* a double rotation) below the locks already held.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rebalanceToRight(Link* parent, Link* node, Link* left, int hR0)
+{
+    LinkLock leftLock(left);
+    int hL = left->height.load();
+    if (hL - hR0 <= 1) return node;
+
+    Link* leftRight = left->right.load();
+    int hLL0 = heightOf(left->left.load());
+    int hLR0 = heightOf(leftRight);
+    if (hLL0 >= hLR0) return rotateRight(parent, node, left, hR0, hLL0, leftRight, hLR0);
+    {
+        LinkLock leftRightLock(leftRight);
+        int hLR = leftRight->height.load();
+        if (hLL0 >= hLR) return rotateRight(parent, node, left, hR0, hLL0, leftRight, hLR);
+
+        int hLRL = heightOf(leftRight->left.load());
+        int balance = hLL0 - hLRL;
+        if (balance >= -1 && balance <= 1) {
+            return rotateRightOverLeft(parent, node, left, hR0, hLL0, leftRight, hLRL);
+        }
+    }
+    // the double rotation would leave left unbalanced; rotate it first
+    return rebalanceToLeft(node, left, leftRight, hLL0);
+}
+
+/**
+* Mirror image of rebalanceToRight().
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rebalanceToLeft(Link* parent, Link* node, Link* right, int hL0)
+{
+    LinkLock rightLock(right);
+    int hR = right->height.load();
+    if (hL0 - hR >= -1) return node;
+
+    Link* rightLeft = right->left.load();
+    int hRL0 = heightOf(rightLeft);
+    int hRR0 = heightOf(right->right.load());
+    if (hRR0 >= hRL0) return rotateLeft(parent, node, hL0, right, rightLeft, hRL0, hRR0);
+    {
+        LinkLock rightLeftLock(rightLeft);
+        int hRL = rightLeft->height.load();
+        if (hRR0 >= hRL) return rotateLeft(parent, node, hL0, right, rightLeft, hRL, hRR0);
+
+        int hRLR = heightOf(rightLeft->right.load());
+        int balance = hRR0 - hRLR;
+        if (balance >= -1 && balance <= 1) {
+            return rotateLeftOverRight(parent, node, hL0, right, rightLeft, hRR0, hRLR);
+        }
+    }
+    return rebalanceToRight(node, right, rightLeft, hRR0);
+}
+
+/**
+* Rotates left up into node's place; node, its parent and left are
+* locked. node's range shrinks, so readers standing on it are told to
+* wait and retry through its version. Returns the next node to repair.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rotateRight(Link* parent, Link* node, Link* left,
+    int hR, int hLL, Link* leftRight, int hLR)
+{
+    unsigned long nodeV = node->version.load();
+    int hOld = node->height.load();
+    Link* parentLeft = parent->left.load();
+
+    node->version.store(beginChange(nodeV));
+    node->left.store(leftRight);
+    if (leftRight != nullptr) leftRight->parent.store(node);
+    left->right.store(node);
+    node->parent.store(left);
+    if (parentLeft == node) parent->left.store(left);
+    else parent->right.store(left);
+    left->parent.store(parent);
+
+    int hNode = 1 + std::max(hLR, hR);
+    node->height.store(hNode);
+    left->height.store(1 + std::max(hLL, hNode));
+    node->version.store(endChange(nodeV));
+
+    Link* damaged = nullptr;
+    int balanceNode = hLR - hR;
+    int balanceLeft = hLL - hNode;
+    if (balanceNode < -1 || balanceNode > 1) damaged = node;
+    else if ((leftRight == nullptr || hR == 0) && node->value.load() == nullptr) damaged = node;
+    else if (balanceLeft < -1 || balanceLeft > 1) damaged = left;
+    else if (hLL == 0 && left->value.load() == nullptr) damaged = left;
+    return finishRotation(parent, left, hOld, damaged);
+}
+
+/**
+* Mirror image of rotateRight().
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rotateLeft(Link* parent, Link* node, int hL, Link* right,
+    Link* rightLeft, int hRL, int hRR)
+{
+    unsigned long nodeV = node->version.load();
+    int hOld = node->height.load();
+    Link* parentLeft = parent->left.load();
+
+    node->version.store(beginChange(nodeV));
+    node->right.store(rightLeft);
+    if (rightLeft != nullptr) rightLeft->parent.store(node);
+    right->left.store(node);
+    node->parent.store(right);
+    if (parentLeft == node) parent->left.store(right);
+    else parent->right.store(right);
+    right->parent.store(parent);
+
+    int hNode = 1 + std::max(hL, hRL);
+    node->height.store(hNode);
+    right->height.store(1 + std::max(hNode, hRR));
+    node->version.store(endChange(nodeV));
+
+    Link* damaged = nullptr;
+    int balanceNode = hRL - hL;
+    int balanceRight = hRR - hNode;
+    if (balanceNode < -1 || balanceNode > 1) damaged = node;
+    else if ((rightLeft == nullptr || hL == 0) && node->value.load() == nullptr) damaged = node;
+    else if (balanceRight < -1 || balanceRight > 1) damaged = right;
+    else if (hRR == 0 && right->value.load() == nullptr) damaged = right;
+    return finishRotation(parent, right, hOld, damaged);
+}
+
+/**
+* Double rotation bringing leftRight up into node's place; parent, node,
+* left and leftRight are locked. Both node and left shrink. A routing
+* left that ends up with a missing child is spliced out straight away,
+* while its new parent is still locked.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rotateRightOverLeft(Link* parent, Link* node, Link* left,
+    int hR, int hLL, Link* leftRight, int hLRL)
+{
+    unsigned long nodeV = node->version.load();
+    int hOld = node->height.load();
+    unsigned long leftV = left->version.load();
+    Link* parentLeft = parent->left.load();
+    Link* leftRightLeft = leftRight->left.load();
+    Link* leftRightRight = leftRight->right.load();
+    int hLRR = heightOf(leftRightRight);
+
+    node->version.store(beginChange(nodeV));
+    left->version.store(beginChange(leftV));
+    node->left.store(leftRightRight);
+    if (leftRightRight != nullptr) leftRightRight->parent.store(node);
+    left->right.store(leftRightLeft);
+    if (leftRightLeft != nullptr) leftRightLeft->parent.store(left);
+    leftRight->left.store(left);
+    left->parent.store(leftRight);
+    leftRight->right.store(node);
+    node->parent.store(leftRight);
+    if (parentLeft == node) parent->left.store(leftRight);
+    else parent->right.store(leftRight);
+    leftRight->parent.store(parent);
+
+    int hNode = 1 + std::max(hLRR, hR);
+    node->height.store(hNode);
+    int hLeft = 1 + std::max(hLL, hLRL);
+    left->height.store(hLeft);
+    leftRight->height.store(1 + std::max(hLeft, hNode));
+    node->version.store(endChange(nodeV));
+    left->version.store(endChange(leftV));
+    if ((hLL == 0 || hLRL == 0) && left->value.load() == nullptr && attemptUnlink(leftRight, left)) {
+        hLeft = std::max(hLL, hLRL);
+        leftRight->height.store(1 + std::max(hLeft, hNode));
+    }
+
+    Link* damaged = nullptr;
+    int balanceNode = hLRR - hR;
+    int balanceTop = hLeft - hNode;
+    if (balanceNode < -1 || balanceNode > 1) damaged = node;
+    else if ((leftRightRight == nullptr || hR == 0) && node->value.load() == nullptr) damaged = node;
+    else if (balanceTop < -1 || balanceTop > 1) damaged = leftRight;
+    return finishRotation(parent, leftRight, hOld, damaged);
+}
+
+/**
+* Mirror image of rotateRightOverLeft().
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::rotateLeftOverRight(Link* parent, Link* node, int hL, Link* right,
+    Link* rightLeft, int hRR, int hRLR)
+{
+    unsigned long nodeV = node->version.load();
+    int hOld = node->height.load();
+    unsigned long rightV = right->version.load();
+    Link* parentLeft = parent->left.load();
+    Link* rightLeftLeft = rightLeft->left.load();
+    Link* rightLeftRight = rightLeft->right.load();
+    int hRLL = heightOf(rightLeftLeft);
+
+    node->version.store(beginChange(nodeV));
+    right->version.store(beginChange(rightV));
+    node->right.store(rightLeftLeft);
+    if (rightLeftLeft != nullptr) rightLeftLeft->parent.store(node);
+    right->left.store(rightLeftRight);
+    if (rightLeftRight != nullptr) rightLeftRight->parent.store(right);
+    rightLeft->right.store(right);
+    right->parent.store(rightLeft);
+    rightLeft->left.store(node);
+    node->parent.store(rightLeft);
+    if (parentLeft == node) parent->left.store(rightLeft);
+    else parent->right.store(rightLeft);
+    rightLeft->parent.store(parent);
+
+    int hNode = 1 + std::max(hL, hRLL);
+    node->height.store(hNode);
+    int hRight = 1 + std::max(hRLR, hRR);
+    right->height.store(hRight);
+    rightLeft->height.store(1 + std::max(hNode, hRight));
+    node->version.store(endChange(nodeV));
+    right->version.store(endChange(rightV));
+    if ((hRR == 0 || hRLR == 0) && right->value.load() == nullptr && attemptUnlink(rightLeft, right)) {
+        hRight = std::max(hRR, hRLR);
+        rightLeft->height.store(1 + std::max(hNode, hRight));
+    }
+
+    Link* damaged = nullptr;
+    int balanceNode = hRLL - hL;
+    int balanceTop = hRight - hNode;
+    if (balanceNode < -1 || balanceNode > 1) damaged = node;
+    else if ((rightLeftLeft == nullptr || hL == 0) && node->value.load() == nullptr) damaged = node;
+    else if (balanceTop < -1 || balanceTop > 1) damaged = rightLeft;
+    return finishRotation(parent, rightLeft, hOld, damaged);
+}
+
+/**
+* Ends a rotation that moved top into the place of a node whose height
+* was oldHeight. A node the rotation left damaged is returned for repair,
+* and top is stored at oldHeight, the height parent was computed from:
+* that repair walks back up through top, which then corrects its height
+* and passes any change on to parent. Otherwise parent is fixed now.
+*/
+template<class Key, class Value, class Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Link*
+ConcurrentAVLTree<Key, Value, Compare>::finishRotation(Link* parent, Link* top, int oldHeight, Link* damaged)
+{
+    if (damaged == nullptr) return fixHeight(parent);
+    top->height.store(oldHeight);
+    return damaged;
+}
+
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyLink(void* node)
+{
+    delete static_cast<KeyedLink*>(static_cast<Link*>(node));
+}
+
+template<class Key, class Value, class Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyValue(void* value)
+{
+    delete static_cast<Value*>(value);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
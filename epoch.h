@@ -0,0 +1,231 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+* Epoch-based memory reclamation for structures whose readers take no
+* locks. Every operation that touches shared nodes runs inside a Guard.
+* A node that has been unlinked is passed to retire() instead of being
+* deleted, and is freed once the global epoch has moved on twice: the
+* epoch only advances when every thread inside a guard has seen the
+* current one, so by then no guard can still hold a pointer to it.
+*
+* There is one process-wide domain. Threads register on first use and
+* hand their pending objects over to the domain when they exit, so a
+* retired object may outlive the structure it came from; deleters must
+* not refer back to it.
+*/
+class EpochReclaimer
+{
+    struct Participant;
+
+public:
+    /**
+    * Marks the calling thread as reading shared nodes. Guards nest.
+    */
+    class Guard
+    {
+    public:
+        Guard();
+        ~Guard();
+
+    private:
+        Guard(const Guard&);
+        Guard& operator=(const Guard&);
+
+        Participant* self_;
+    };
+
+    template<typename T>
+    static void retire(T* p);
+    static void retire(void* p, void (*deleter)(void*));
+    static void collect();
+
+private:
+    struct Retired {
+        void* p;
+        void (*deleter)(void*);
+        unsigned long epoch;
+    };
+    // One per thread; reused by a later thread once its owner exits.
+    struct Participant {
+        std::atomic<unsigned long> epoch;   // (global epoch << 1) | 1 inside a guard, else 0
+        std::atomic<bool> inUse;
+        unsigned depth;
+        unsigned sinceCollect;
+        std::vector<Retired> retired;
+        Participant* next;
+    };
+    struct Registry {
+        std::atomic<unsigned long> epoch;
+        std::atomic<Participant*> participants;
+        std::mutex orphanLock;
+        std::vector<Retired> orphans;     // left behind by exited threads
+    };
+    // Thread-local; claims a Participant and gives it back at thread exit.
+    struct Registration {
+        Registration();
+        ~Registration();
+        Participant* self;
+    };
+
+    template<typename T>
+    static void deleteObject(void* p);
+    static Registry& registry();
+    static Participant& self();
+    static bool tryAdvance(Registry& r);
+    static void freeRetired(std::vector<Retired>& list, unsigned long now);
+
+    static const unsigned COLLECT_INTERVAL = 64;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the EpochReclaimer class.
+  ---------------------------------------------------
+*/
+
+/**
+* Enters the current epoch. The epoch is published and then re-read, so
+* an advance that raced with the publication is never missed.
+*/
+inline EpochReclaimer::Guard::Guard() : self_(&EpochReclaimer::self())
+{
+    if (self_->depth++ > 0) return;
+    Registry& r = registry();
+    unsigned long e = r.epoch.load();
+    for (;;) {
+        self_->epoch.store(e << 1 | 1);
+        unsigned long now = r.epoch.load();
+        if (now == e) break;
+        e = now;
+    }
+}
+
+inline EpochReclaimer::Guard::~Guard()
+{
+    if (--self_->depth == 0) self_->epoch.store(0, std::memory_order_release);
+}
+
+/**
+* Queues p to be deleted once no guard can still see it.
+*/
+template<typename T>
+void EpochReclaimer::retire(T* p)
+{
+    retire(p, &deleteObject<T>);
+}
+
+inline void EpochReclaimer::retire(void* p, void (*deleter)(void*))
+{
+    Participant& me = self();
+    Retired item = { p, deleter, registry().epoch.load() };
+    me.retired.push_back(item);
+    if (++me.sinceCollect >= COLLECT_INTERVAL) {
+        me.sinceCollect = 0;
+        collect();
+    }
+}
+
+/**
+* Advances the epoch if every thread in a guard has caught up, then frees
+* what the calling thread (and any exited thread) retired two epochs ago.
+*/
+inline void EpochReclaimer::collect()
+{
+    Registry& r = registry();
+    tryAdvance(r);
+    unsigned long now = r.epoch.load();
+    freeRetired(self().retired, now);
+    if (r.orphanLock.try_lock()) {
+        freeRetired(r.orphans, now);
+        r.orphanLock.unlock();
+    }
+}
+
+template<typename T>
+void EpochReclaimer::deleteObject(void* p)
+{
+    delete static_cast<T*>(p);
+}
+
+/**
+* The domain is never destroyed, so threads that exit after main() still
+* find it.
+*/
+inline EpochReclaimer::Registry& EpochReclaimer::registry()
+{
+    static Registry* r = new Registry();
+    return *r;
+}
+
+inline EpochReclaimer::Participant& EpochReclaimer::self()
+{
+    static thread_local Registration registration;
+    return *registration.self;
+}
+
+inline bool EpochReclaimer::tryAdvance(Registry& r)
+{
+    unsigned long e = r.epoch.load();
+    unsigned long current = e << 1 | 1;
+    for (Participant* p = r.participants.load(); p != nullptr; p = p->next) {
+        unsigned long seen = p->epoch.load();
+        if (seen != 0 && seen != current) return false;
+    }
+    return r.epoch.compare_exchange_strong(e, e + 1);
+}
+
+inline void EpochReclaimer::freeRetired(std::vector<Retired>& list, unsigned long now)
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < list.size(); i++) {
+        if (list[i].epoch + 2 <= now) list[i].deleter(list[i].p);
+        else list[kept++] = list[i];
+    }
+    list.resize(kept);
+}
+
+inline EpochReclaimer::Registration::Registration() : self(nullptr)
+{
+    Registry& r = registry();
+    for (Participant* p = r.participants.load(); p != nullptr; p = p->next) {
+        bool free = false;
+        if (p->inUse.compare_exchange_strong(free, true)) {
+            self = p;
+            return;
+        }
+    }
+    Participant* p = new Participant();
+    p->epoch.store(0);
+    p->inUse.store(true);
+    p->depth = 0;
+    p->sinceCollect = 0;
+    p->next = r.participants.load();
+    while (!r.participants.compare_exchange_weak(p->next, p)) { }
+    self = p;
+}
+
+inline EpochReclaimer::Registration::~Registration()
+{
+    Registry& r = registry();
+    if (!self->retired.empty()) {
+        std::lock_guard<std::mutex> lock(r.orphanLock);
+        r.orphans.insert(r.orphans.end(), self->retired.begin(), self->retired.end());
+        self->retired.clear();
+    }
+    self->sinceCollect = 0;
+    self->inUse.store(false);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the EpochReclaimer class.
+  -------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include "equal-paths.h"
+using namespace std;
+
+/*
+ * Stress test for equalPaths on deep trees.
+ * Usage: equal-paths-stress [n]   (default 50000000)
+ * Builds an n-node chain (one long path) and an n-node "caterpillar"
+ * (a chain with an extra leaf hanging off every node) and times
+ * equalPaths on each.
+ */
+
+typedef chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+void report(const char* shape, const char* what, double ms)
+{
+    cout << "stress\t" << shape << "\t" << what << "\t" << ms << " ms" << endl;
+}
+
+// frees a tree whose nodes all hang off the right spine
+void freeSpine(Node* root)
+{
+    while (root != NULL) {
+        Node* next = root->right;
+        delete root->left;
+        delete root;
+        root = next;
+    }
+}
+
+void stress(const char* shape, int n, bool withLeaves, bool expected)
+{
+    Clock::time_point start = Clock::now();
+    Node* root = NULL;
+    for (int i = 0; i < n; i++) {
+        root = new Node(i, withLeaves && root != NULL ? new Node(-i) : NULL, root);
+    }
+    report(shape, "build", elapsedMs(start));
+
+    start = Clock::now();
+    bool result = equalPaths(root);
+    report(shape, "equalPaths", elapsedMs(start));
+    if (result != expected) cerr << shape << ": wrong answer" << endl;
+
+    start = Clock::now();
+    freeSpine(root);
+    report(shape, "free", elapsedMs(start));
+}
+
+int main(int argc, char* argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 50000000;
+    if (n <= 0) {
+        cerr << "usage: equal-paths-stress [n]" << endl;
+        return 1;
+    }
+    stress("chain", n, false, true);
+    // leaves at depths 1, 2, ..., n - 1 and the bottom of the chain
+    stress("caterpillar", n / 2, true, n / 2 <= 2);
+    return 0;
+}
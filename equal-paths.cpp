@@ -1,6 +1,7 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
-
+#include <vector>
+#include <utility>
 #endif
 
 #include "equal-paths.h"
@@ -8,27 +9,38 @@ using namespace std;
 
 
 // You may add any prototypes of helper functions here
-bool checkEqualDepth(Node* node, int currentDepth, int& maxDepth) {
-    // base case
-    if (node == nullptr) return true;
-    
-    // if it's a leaf node
-    if (node->left == nullptr && node->right == nullptr) {
-        // if first leaf node, save as depth
-        if (maxDepth == -1) {
-            maxDepth = currentDepth;
-        }
-        // not first node, check if depth and maxDepth the same
-        else {
-            return (currentDepth == maxDepth);
+// Walks the tree depth first with an explicit stack of (node, depth) pairs so
+// a degenerate tree cannot overflow the call stack. Right children are pushed
+// before left ones, so at most one pending sibling per level is on the stack.
+bool checkEqualDepth(Node* root) {
+    // marker to see first leaf's depth later
+    int leafDepth = -1;
+    vector<pair<Node*, int> > pending;
+    pending.push_back(make_pair(root, 0));
+
+    while (!pending.empty()) {
+        Node* node = pending.back().first;
+        int depth = pending.back().second;
+        pending.pop_back();
+
+        // if it's a leaf node
+        if (node->left == nullptr && node->right == nullptr) {
+            // if first leaf node, save as depth
+            if (leafDepth == -1) {
+                leafDepth = depth;
+            }
+            // not first leaf, check depth is the same
+            else if (depth != leafDepth) {
+                return false;
+            }
+            continue;
         }
-    }
 
-    // not leaf node, continue
-    bool leftSubtree = checkEqualDepth(node->left, currentDepth + 1, maxDepth);
-    bool rightSubtree = checkEqualDepth(node->right, currentDepth + 1, maxDepth);
-    // check if both are equal at end
-    return (leftSubtree && rightSubtree);
+        // not leaf node, continue
+        if (node->right != nullptr) pending.push_back(make_pair(node->right, depth + 1));
+        if (node->left != nullptr) pending.push_back(make_pair(node->left, depth + 1));
+    }
+    return true;
 }
 
 
@@ -39,15 +51,13 @@ bool equalPaths(Node * root)
     // true -- all paths from leaves to root are same length
     // parameter = root = pointer to root of tree to check for equal paths
 
-    if (root->left == nullptr && root->right == nullptr) {
-        // just root
+    // an empty tree has no paths, so they are trivially equal
+    if (root == nullptr) {
         return true;
     }
 
     // check first leaf node depth, compare others to it
-    // marker to see first node's depth later
-    int maxDepth = -1;
-    return checkEqualDepth(root, 0, maxDepth);
+    return checkEqualDepth(root);
 
 }
 
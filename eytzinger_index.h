@@ -0,0 +1,394 @@
+#ifndef EYTZINGER_INDEX_H
+#define EYTZINGER_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The AVX2 search is compiled for that target alone and only called
+// after a check at run time, so the rest of the build needs no -mavx2.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EYTZINGER_X86 1
+#define EYTZINGER_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(__GNUC__)
+#define EYTZINGER_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define EYTZINGER_PREFETCH(p) ((void)0)
+#endif
+
+/**
+* A read-only index for 32- and 64-bit integer keys, built from the
+* sorted items of a tree (or any sorted range with unique keys).
+*
+* The keys form a static B+ tree of B-key nodes, B chosen so a node is
+* one 64-byte cache line (16 keys of 32 bits, 8 of 64), numbered the
+* Eytzinger way: the children of node k on a level are k * (B + 1) + i
+* on the level below, so no links are stored. The bottom level is just
+* the sorted keys, padded to whole nodes, and each node above holds the
+* smallest key under each of its children but the first. A lookup counts
+* the keys less than the probe in one node per level, which is the child
+* to go to next; at the bottom the count gives the rank of the answer.
+* There are no data-dependent branches, and every level costs at most
+* one cache miss.
+*
+* Where the CPU has AVX2 each node is compared in two vector compares;
+* elsewhere a scalar loop does the same count. The choice is made once,
+* when the index is built.
+*/
+template <typename Key, typename Value>
+class EytzingerIndex
+{
+    static_assert(std::is_integral<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8),
+        "EytzingerIndex keys must be 32- or 64-bit integers");
+
+public:
+    typedef std::pair<const Key, Value> value_type;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+
+    EytzingerIndex();
+    // [first, last) must be in ascending key order with no repeated keys.
+    template<typename InputIt>
+    EytzingerIndex(InputIt first, InputIt last);
+    EytzingerIndex(const EytzingerIndex& other);
+    EytzingerIndex& operator=(const EytzingerIndex& other);
+    void swap(EytzingerIndex& other);
+
+    const_iterator find(Key key) const;
+    const_iterator lower_bound(Key key) const;
+    const_iterator upper_bound(Key key) const;
+    Value const & operator[](Key key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+    std::size_t bytesReserved() const;
+
+    // Whether lookups use the AVX2 path. disableSimd() forces the scalar
+    // one, to compare the two.
+    bool simd() const;
+    void disableSimd();
+
+private:
+    // Keys are stored signed, unsigned ones with the top bit flipped, so
+    // that one signed compare orders both.
+    typedef typename std::make_signed<Key>::type Stored;
+
+    static const unsigned LINE = 64;
+    static const unsigned B = LINE / sizeof(Key);
+
+    static Stored toStored(Key key);
+    static bool cpuHasAvx2();
+    void buildLayout();
+    const Stored* node(std::size_t level, std::size_t k) const;
+    std::size_t rankOf(Key key) const;
+    std::size_t searchScalar(Stored key) const;
+#ifdef EYTZINGER_X86
+    EYTZINGER_AVX2 std::size_t searchAvx2(Stored key) const;
+    EYTZINGER_AVX2 static unsigned countLessAvx2(const Stored* node, Stored key);
+#endif
+
+    std::vector<value_type> items_;
+    // Node storage with room to start on a cache line; levels_[l] is the
+    // first node of level l (0 is the bottom), in nodes from base_.
+    std::vector<Stored> keys_;
+    std::size_t base_;
+    std::vector<std::size_t> levels_;
+    bool avx2_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the EytzingerIndex class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value>
+EytzingerIndex<Key, Value>::EytzingerIndex()
+    : base_(0), avx2_(cpuHasAvx2())
+{
+}
+
+template<class Key, class Value>
+template<typename InputIt>
+EytzingerIndex<Key, Value>::EytzingerIndex(InputIt first, InputIt last)
+    : base_(0), avx2_(cpuHasAvx2())
+{
+    for (; first != last; ++first) {
+        items_.push_back(*first);
+    }
+    items_.shrink_to_fit();
+    buildLayout();
+}
+
+/**
+* The copy's key storage may sit differently against a cache line, so
+* the nodes are laid out again rather than copied.
+*/
+template<class Key, class Value>
+EytzingerIndex<Key, Value>::EytzingerIndex(const EytzingerIndex& other)
+    : items_(other.items_), base_(0), avx2_(other.avx2_)
+{
+    buildLayout();
+}
+
+template<class Key, class Value>
+EytzingerIndex<Key, Value>& EytzingerIndex<Key, Value>::operator=(const EytzingerIndex& other)
+{
+    if (this != &other) {
+        EytzingerIndex copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+void EytzingerIndex<Key, Value>::swap(EytzingerIndex& other)
+{
+    items_.swap(other.items_);
+    keys_.swap(other.keys_);
+    std::swap(base_, other.base_);
+    levels_.swap(other.levels_);
+    std::swap(avx2_, other.avx2_);
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::const_iterator
+EytzingerIndex<Key, Value>::find(Key key) const
+{
+    std::size_t rank = rankOf(key);
+    if (rank < items_.size() && items_[rank].first == key) return items_.begin() + rank;
+    return items_.end();
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::const_iterator
+EytzingerIndex<Key, Value>::lower_bound(Key key) const
+{
+    return items_.begin() + rankOf(key);
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::const_iterator
+EytzingerIndex<Key, Value>::upper_bound(Key key) const
+{
+    if (key == std::numeric_limits<Key>::max()) return items_.end();
+    return lower_bound(key + 1);
+}
+
+template<class Key, class Value>
+Value const & EytzingerIndex<Key, Value>::operator[](Key key) const
+{
+    const_iterator it = find(key);
+    if (it == items_.end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return it->second;
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::const_iterator
+EytzingerIndex<Key, Value>::begin() const
+{
+    return items_.begin();
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::const_iterator
+EytzingerIndex<Key, Value>::end() const
+{
+    return items_.end();
+}
+
+template<class Key, class Value>
+std::size_t EytzingerIndex<Key, Value>::size() const
+{
+    return items_.size();
+}
+
+template<class Key, class Value>
+bool EytzingerIndex<Key, Value>::empty() const
+{
+    return items_.empty();
+}
+
+template<class Key, class Value>
+std::size_t EytzingerIndex<Key, Value>::bytesReserved() const
+{
+    return items_.capacity() * sizeof(value_type) + keys_.capacity() * sizeof(Stored)
+        + levels_.capacity() * sizeof(std::size_t);
+}
+
+template<class Key, class Value>
+bool EytzingerIndex<Key, Value>::simd() const
+{
+    return avx2_;
+}
+
+template<class Key, class Value>
+void EytzingerIndex<Key, Value>::disableSimd()
+{
+    avx2_ = false;
+}
+
+template<class Key, class Value>
+typename EytzingerIndex<Key, Value>::Stored EytzingerIndex<Key, Value>::toStored(Key key)
+{
+    if (std::is_signed<Key>::value) return static_cast<Stored>(key);
+    return static_cast<Stored>(key ^ (Key(1) << (8 * sizeof(Key) - 1)));
+}
+
+template<class Key, class Value>
+bool EytzingerIndex<Key, Value>::cpuHasAvx2()
+{
+#ifdef EYTZINGER_X86
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+/**
+* Sizes the levels bottom up, each (B + 1) times narrower than the one
+* below, then fills them. Padding and the keys of missing children are
+* the largest Stored value, which never counts as less than a probe.
+*/
+template<class Key, class Value>
+void EytzingerIndex<Key, Value>::buildLayout()
+{
+    keys_.clear();
+    levels_.clear();
+    base_ = 0;
+    if (items_.empty()) return;
+
+    std::vector<std::size_t> widths(1, (items_.size() + B - 1) / B);
+    while (widths.back() > 1) {
+        widths.push_back((widths.back() + B) / (B + 1));
+    }
+    // the top levels go first, so the hot ones share pages
+    std::size_t nodes = 0;
+    levels_.resize(widths.size());
+    for (std::size_t l = widths.size(); l-- > 0; ) {
+        levels_[l] = nodes;
+        nodes += widths[l];
+    }
+    keys_.assign(nodes * B + LINE / sizeof(Stored), std::numeric_limits<Stored>::max());
+    std::size_t misalign = reinterpret_cast<std::uintptr_t>(keys_.data()) % LINE;
+    base_ = misalign == 0 ? 0 : (LINE - misalign) / sizeof(Stored);
+
+    Stored* bottom = &keys_[base_ + levels_[0] * B];
+    for (std::size_t i = 0; i < items_.size(); i++) {
+        bottom[i] = toStored(items_[i].first);
+    }
+    for (std::size_t l = 1; l < widths.size(); l++) {
+        Stored* level = &keys_[base_ + levels_[l] * B];
+        for (std::size_t k = 0; k < widths[l]; k++) {
+            for (unsigned i = 0; i < B; i++) {
+                // the leftmost bottom node under child i + 1
+                std::size_t leaf = k * (B + 1) + i + 1;
+                for (std::size_t down = 1; down < l && leaf < widths[0]; down++) {
+                    leaf *= B + 1;
+                }
+                if (leaf < widths[0]) level[k * B + i] = bottom[leaf * B];
+            }
+        }
+    }
+}
+
+template<class Key, class Value>
+const typename EytzingerIndex<Key, Value>::Stored*
+EytzingerIndex<Key, Value>::node(std::size_t level, std::size_t k) const
+{
+    return &keys_[base_ + (levels_[level] + k) * B];
+}
+
+/**
+* The number of items before key: the rank of its lower bound.
+*/
+template<class Key, class Value>
+std::size_t EytzingerIndex<Key, Value>::rankOf(Key key) const
+{
+    if (items_.empty()) return 0;
+#ifdef EYTZINGER_X86
+    if (avx2_) return searchAvx2(toStored(key));
+#endif
+    return searchScalar(toStored(key));
+}
+
+/**
+* Once the bottom node is known, the items it covers are fetched at the
+* same time as its keys, so a hit does not wait for a second miss.
+*/
+template<class Key, class Value>
+std::size_t EytzingerIndex<Key, Value>::searchScalar(Stored key) const
+{
+    std::size_t k = 0;
+    for (std::size_t l = levels_.size() - 1; ; l--) {
+        const Stored* keys = node(l, k);
+        unsigned less = 0;
+        for (unsigned i = 0; i < B; i++) {
+            less += keys[i] < key;
+        }
+        if (l == 0) return std::min(k * B + less, items_.size());
+        k = k * (B + 1) + less;
+        if (l == 1) EYTZINGER_PREFETCH(&items_[k * B]);
+    }
+}
+
+#ifdef EYTZINGER_X86
+template<class Key, class Value>
+std::size_t EytzingerIndex<Key, Value>::searchAvx2(Stored key) const
+{
+    std::size_t k = 0;
+    for (std::size_t l = levels_.size() - 1; ; l--) {
+        unsigned less = countLessAvx2(node(l, k), key);
+        if (l == 0) return std::min(k * B + less, items_.size());
+        k = k * (B + 1) + less;
+        if (l == 1) EYTZINGER_PREFETCH(&items_[k * B]);
+    }
+}
+
+/**
+* Node keys are sorted, so the lanes less than key form a prefix of the
+* mask and its length is the count of trailing ones.
+*/
+template<class Key, class Value>
+unsigned EytzingerIndex<Key, Value>::countLessAvx2(const Stored* node, Stored key)
+{
+    const __m256i* lanes = reinterpret_cast<const __m256i*>(node);
+    unsigned mask;
+    if (sizeof(Stored) == 4) {
+        __m256i probe = _mm256_set1_epi32(static_cast<int>(key));
+        __m256i low = _mm256_cmpgt_epi32(probe, _mm256_load_si256(lanes));
+        __m256i high = _mm256_cmpgt_epi32(probe, _mm256_load_si256(lanes + 1));
+        mask = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(low)))
+            | unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(high))) << 8;
+    }
+    else {
+        __m256i probe = _mm256_set1_epi64x(static_cast<long long>(key));
+        __m256i low = _mm256_cmpgt_epi64(probe, _mm256_load_si256(lanes));
+        __m256i high = _mm256_cmpgt_epi64(probe, _mm256_load_si256(lanes + 1));
+        mask = unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(low)))
+            | unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(high))) << 4;
+    }
+    return __builtin_ctz(~mask);
+}
+#endif
+
+/*
+  --------------------------------------------------
+  End implementations for the EytzingerIndex class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef FROZEN_BST_H
+#define FROZEN_BST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* An immutable search tree with no pointers, as returned by freeze().
+* The items sit in one sorted array, which is what iteration walks. The
+* search runs over a second array holding just the keys of a perfect
+* binary tree in van Emde Boas order: the top half of the levels comes
+* first, then each subtree hanging below it, each laid out the same way
+* recursively. Any root-to-leaf path then touches O(log_B n) cache lines
+* for every line size B at once, instead of one line per level.
+*
+* The perfect tree has 2^h - 1 slots for n items; the slots past the
+* last item repeat its key, so the key array is up to twice as long as
+* n. A child's position is computed from per-level tables while walking
+* down, so no links are stored.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenTree
+{
+public:
+    typedef std::pair<const Key, Value> value_type;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    explicit FrozenTree(const Compare& comp = Compare());
+    // [first, last) must be sorted under comp with no repeated keys.
+    template<typename InputIt>
+    FrozenTree(InputIt first, InputIt last, const Compare& comp = Compare());
+    FrozenTree& operator=(const FrozenTree& other);
+    void swap(FrozenTree& other);
+
+    const_iterator find(const Key& key) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+    std::size_t size() const;
+    bool empty() const;
+    // bytes held by the item and key arrays
+    std::size_t bytesReserved() const;
+
+private:
+    void buildLayout();
+    void splitLevels(int top, int height);
+    void appendSlots(std::size_t index, int depth, int height);
+    template<bool Upper>
+    std::size_t search(const Key& key) const;
+
+    // a perfect tree of 2^63 slots would not fit in memory anyway
+    static const int MAX_HEIGHT = 64;
+
+    std::vector<value_type> items_;
+    std::vector<Key> keys_;     // perfect tree of height_ levels, vEB order
+    int height_;
+    // For each depth d > 0, nodes at d are roots of bottom trees in the
+    // split of the subtree rooted at depth topDepth_[d]: the top part
+    // holds topMask_[d] slots and each bottom tree bottomSize_[d].
+    int topDepth_[MAX_HEIGHT];
+    std::size_t topMask_[MAX_HEIGHT];
+    std::size_t bottomSize_[MAX_HEIGHT];
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FrozenTree class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree(const Compare& comp)
+    : height_(0), topDepth_(), topMask_(), bottomSize_(), comp_(comp)
+{
+}
+
+template<class Key, class Value, class Compare>
+template<typename InputIt>
+FrozenTree<Key, Value, Compare>::FrozenTree(InputIt first, InputIt last, const Compare& comp)
+    : height_(0), topDepth_(), topMask_(), bottomSize_(), comp_(comp)
+{
+    // One pass: measuring a tree's range first would walk it twice.
+    for (; first != last; ++first) {
+        items_.push_back(*first);
+    }
+    items_.shrink_to_fit();
+    buildLayout();
+}
+
+/**
+* The item array holds const keys, so it can only be copied by building
+* a new one.
+*/
+template<class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>&
+FrozenTree<Key, Value, Compare>::operator=(const FrozenTree& other)
+{
+    if (this != &other) {
+        FrozenTree copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::swap(FrozenTree& other)
+{
+    using std::swap;
+    items_.swap(other.items_);
+    keys_.swap(other.keys_);
+    swap(height_, other.height_);
+    for (int d = 0; d < MAX_HEIGHT; d++) {
+        swap(topDepth_[d], other.topDepth_[d]);
+        swap(topMask_[d], other.topMask_[d]);
+        swap(bottomSize_[d], other.bottomSize_[d]);
+    }
+    swap(comp_, other.comp_);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_iterator
+FrozenTree<Key, Value, Compare>::find(const Key& key) const
+{
+    const_iterator it = lower_bound(key);
+    if (it != items_.end() && !comp_(key, it->first)) return it;
+    return items_.end();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_iterator
+FrozenTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return items_.begin() + search<false>(key);
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_iterator
+FrozenTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return items_.begin() + search<true>(key);
+}
+
+template<class Key, class Value, class Compare>
+Value const & FrozenTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const_iterator it = find(key);
+    if (it == items_.end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return it->second;
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_iterator
+FrozenTree<Key, Value, Compare>::begin() const
+{
+    return items_.begin();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_iterator
+FrozenTree<Key, Value, Compare>::end() const
+{
+    return items_.end();
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_reverse_iterator
+FrozenTree<Key, Value, Compare>::rbegin() const
+{
+    return const_reverse_iterator(items_.end());
+}
+
+template<class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::const_reverse_iterator
+FrozenTree<Key, Value, Compare>::rend() const
+{
+    return const_reverse_iterator(items_.begin());
+}
+
+template<class Key, class Value, class Compare>
+std::size_t FrozenTree<Key, Value, Compare>::size() const
+{
+    return items_.size();
+}
+
+template<class Key, class Value, class Compare>
+bool FrozenTree<Key, Value, Compare>::empty() const
+{
+    return items_.empty();
+}
+
+template<class Key, class Value, class Compare>
+std::size_t FrozenTree<Key, Value, Compare>::bytesReserved() const
+{
+    return items_.capacity() * sizeof(value_type) + keys_.capacity() * sizeof(Key);
+}
+
+/**
+* Sizes the perfect tree, fills the level tables and appends the slot
+* keys in vEB order.
+*/
+template<class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::buildLayout()
+{
+    height_ = 0;
+    while (height_ < MAX_HEIGHT - 1 && ((std::size_t(1) << height_) - 1) < items_.size()) {
+        height_++;
+    }
+    if (height_ == 0) return;
+    splitLevels(0, height_);
+    keys_.reserve((std::size_t(1) << height_) - 1);
+    appendSlots(1, 0, height_);
+}
+
+/**
+* Records how the subtree rooted at depth top, height levels tall, is
+* split: the top floor(height / 2) levels, then the bottom trees below.
+*/
+template<class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::splitLevels(int top, int height)
+{
+    if (height <= 1) return;
+    int upper = height / 2;
+    int lower = height - upper;
+    int d = top + upper;
+    topDepth_[d] = top;
+    topMask_[d] = (std::size_t(1) << upper) - 1;
+    bottomSize_[d] = (std::size_t(1) << lower) - 1;
+    splitLevels(top, upper);
+    splitLevels(d, lower);
+}
+
+/**
+* Appends the subtree rooted at breadth-first index (root 1, children 2i
+* and 2i + 1) at depth, height levels tall: its top levels, then each
+* bottom tree from left to right, split as splitLevels() recorded. The
+* in-order rank of a slot is its index's path bits with a 1 appended,
+* shifted up to the leaf level, less one.
+*/
+template<class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::appendSlots(std::size_t index, int depth, int height)
+{
+    if (height == 1) {
+        std::size_t path = index - (std::size_t(1) << depth);
+        std::size_t rank = ((path << 1 | 1) << (height_ - 1 - depth)) - 1;
+        keys_.push_back(items_[std::min(rank, items_.size() - 1)].first);
+        return;
+    }
+    int upper = height / 2;
+    appendSlots(index, depth, upper);
+    for (std::size_t j = 0; j < (std::size_t(1) << upper); j++) {
+        appendSlots(index << upper | j, depth + upper, height - upper);
+    }
+}
+
+/**
+* One comparison per level down the full height of the tree. The bits
+* of the final index below its leading 1 are the turns taken, and since
+* the tree is perfect they also count the slots passed on the left: that
+* is the rank of the first slot not before key (after key, for Upper).
+* Ranks in the padding clamp to size().
+*/
+template<class Key, class Value, class Compare>
+template<bool Upper>
+std::size_t FrozenTree<Key, Value, Compare>::search(const Key& key) const
+{
+    if (height_ == 0) return 0;
+    std::size_t pos[MAX_HEIGHT];
+    std::size_t index = 1;
+    pos[0] = 0;
+    for (int d = 0; ; ) {
+        const Key& slot = keys_[pos[d]];
+        bool right = Upper ? !comp_(key, slot) : comp_(slot, key);
+        index = index << 1 | std::size_t(right);
+        if (++d == height_) break;
+        pos[d] = pos[topDepth_[d]] + topMask_[d] + (index & topMask_[d]) * bottomSize_[d];
+    }
+    std::size_t rank = index - (std::size_t(1) << height_);
+    return std::min(rank, items_.size());
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the FrozenTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+/**
+* A slab allocator for fixed-size tree nodes.
+* Nodes are carved out of contiguous blocks that grow geometrically
+* (up to a cap), and freed nodes are threaded onto an intrusive free
+* list so the next allocation can reuse them. release() hands every
+* block back at once, which is what BinarySearchTree::clear() uses
+* instead of freeing nodes one at a time.
+*/
+class NodePool
+{
+public:
+    NodePool(std::size_t nodeSize, std::size_t nodeAlign);
+    ~NodePool();
+
+    void* allocate();
+    void deallocate(void* p);
+    void release();
+    void swap(NodePool& other);
+    void splice(NodePool& other);
+
+    std::size_t nodeSize() const;
+    std::size_t nodeAlign() const;
+    std::size_t bytesReserved() const;
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    // Every block starts with this header; nodes follow it.
+    struct Block {
+        Block* next;
+    };
+    // Freed nodes are reused as free list links.
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    void grow();
+
+    static const std::size_t MIN_BLOCK_NODES = 16;
+    static const std::size_t MAX_BLOCK_BYTES = 1 << 20;
+
+    std::size_t nodeSize_;
+    std::size_t nodeAlign_;
+    std::size_t headerSize_;
+    std::size_t nextBlockNodes_;
+    std::size_t bytesReserved_;
+    Block* blocks_;
+    Block* lastBlock_;      // the oldest block, so splice() can append in O(1)
+    FreeSlot* freeList_;
+    FreeSlot* freeTail_;    // last slot on the free list, likewise
+    char* cursor_;
+    char* end_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+/**
+* Creates an empty pool for nodes of the given size and alignment.
+* No memory is reserved until the first allocation.
+*/
+inline NodePool::NodePool(std::size_t nodeSize, std::size_t nodeAlign) :
+    nodeSize_(nodeSize),
+    nodeAlign_(nodeAlign < alignof(FreeSlot) ? alignof(FreeSlot) : nodeAlign),
+    headerSize_(0),
+    nextBlockNodes_(MIN_BLOCK_NODES),
+    bytesReserved_(0),
+    blocks_(NULL),
+    lastBlock_(NULL),
+    freeList_(NULL),
+    freeTail_(NULL),
+    cursor_(NULL),
+    end_(NULL)
+{
+    // a slot must be able to hold a free list link and keep the next slot aligned
+    if (nodeSize_ < sizeof(FreeSlot)) nodeSize_ = sizeof(FreeSlot);
+    nodeSize_ = (nodeSize_ + nodeAlign_ - 1) / nodeAlign_ * nodeAlign_;
+    headerSize_ = (sizeof(Block) + nodeAlign_ - 1) / nodeAlign_ * nodeAlign_;
+}
+
+/**
+* Frees every block. Objects still living in the pool are not destroyed;
+* the owner is responsible for that.
+*/
+inline NodePool::~NodePool()
+{
+    release();
+}
+
+/**
+* Returns storage for one node, reusing a freed slot when one is available.
+*/
+inline void* NodePool::allocate()
+{
+    if (freeList_ != NULL) {
+        FreeSlot* slot = freeList_;
+        freeList_ = slot->next;
+        if (freeList_ == NULL) freeTail_ = NULL;
+        return slot;
+    }
+    if (cursor_ == end_) {
+        grow();
+    }
+    void* p = cursor_;
+    cursor_ += nodeSize_;
+    return p;
+}
+
+/**
+* Puts a node's storage back on the free list. The node must already
+* have been destroyed.
+*/
+inline void NodePool::deallocate(void* p)
+{
+    if (p == NULL) return;
+    FreeSlot* slot = static_cast<FreeSlot*>(p);
+    slot->next = freeList_;
+    if (freeList_ == NULL) freeTail_ = slot;
+    freeList_ = slot;
+}
+
+/**
+* Returns all blocks to the system in one pass and resets the pool.
+*/
+inline void NodePool::release()
+{
+    while (blocks_ != NULL) {
+        Block* next = blocks_->next;
+        std::free(blocks_);
+        blocks_ = next;
+    }
+    lastBlock_ = NULL;
+    freeList_ = NULL;
+    freeTail_ = NULL;
+    cursor_ = NULL;
+    end_ = NULL;
+    nextBlockNodes_ = MIN_BLOCK_NODES;
+    bytesReserved_ = 0;
+}
+
+/**
+* Exchanges the contents of two pools of the same node size.
+*/
+inline void NodePool::swap(NodePool& other)
+{
+    std::swap(nodeSize_, other.nodeSize_);
+    std::swap(nodeAlign_, other.nodeAlign_);
+    std::swap(headerSize_, other.headerSize_);
+    std::swap(nextBlockNodes_, other.nextBlockNodes_);
+    std::swap(bytesReserved_, other.bytesReserved_);
+    std::swap(blocks_, other.blocks_);
+    std::swap(lastBlock_, other.lastBlock_);
+    std::swap(freeList_, other.freeList_);
+    std::swap(freeTail_, other.freeTail_);
+    std::swap(cursor_, other.cursor_);
+    std::swap(end_, other.end_);
+}
+
+/**
+* Takes over all of other's memory, so nodes allocated from other can be
+* freed into this pool; other is left empty. Both pools must have the
+* same slot size. O(1): both lists are joined at their tails. The unused end
+* of other's current block is not carried over; it is only returned by
+* release().
+*/
+inline void NodePool::splice(NodePool& other)
+{
+    if (other.blocks_ == NULL) return;
+
+    other.lastBlock_->next = blocks_;
+    if (blocks_ == NULL) lastBlock_ = other.lastBlock_;
+    blocks_ = other.blocks_;
+
+    if (other.freeList_ != NULL) {
+        other.freeTail_->next = freeList_;
+        if (freeList_ == NULL) freeTail_ = other.freeTail_;
+        freeList_ = other.freeList_;
+    }
+    bytesReserved_ += other.bytesReserved_;
+
+    other.blocks_ = NULL;
+    other.lastBlock_ = NULL;
+    other.freeList_ = NULL;
+    other.freeTail_ = NULL;
+    other.cursor_ = NULL;
+    other.end_ = NULL;
+    other.nextBlockNodes_ = MIN_BLOCK_NODES;
+    other.bytesReserved_ = 0;
+}
+
+/**
+* Size in bytes of a single slot, including alignment padding.
+*/
+inline std::size_t NodePool::nodeSize() const
+{
+    return nodeSize_;
+}
+
+/**
+* Alignment of every slot handed out by the pool.
+*/
+inline std::size_t NodePool::nodeAlign() const
+{
+    return nodeAlign_;
+}
+
+/**
+* Total bytes currently held in blocks (used or free).
+*/
+inline std::size_t NodePool::bytesReserved() const
+{
+    return bytesReserved_;
+}
+
+/**
+* Allocates a new block, doubling the block size each time until it
+* reaches MAX_BLOCK_BYTES.
+*/
+inline void NodePool::grow()
+{
+    std::size_t bytes = headerSize_ + nextBlockNodes_ * nodeSize_ + nodeAlign_;
+    Block* block = static_cast<Block*>(std::malloc(bytes));
+    if (block == NULL) throw std::bad_alloc();
+    block->next = blocks_;
+    if (blocks_ == NULL) lastBlock_ = block;
+    blocks_ = block;
+    bytesReserved_ += bytes;
+
+    // malloc only guarantees fundamental alignment, so round up by hand
+    std::size_t start = reinterpret_cast<std::size_t>(block) + headerSize_;
+    start = (start + nodeAlign_ - 1) / nodeAlign_ * nodeAlign_;
+    cursor_ = reinterpret_cast<char*>(start);
+    end_ = cursor_ + nextBlockNodes_ * nodeSize_;
+
+    if ((nextBlockNodes_ * 2) * nodeSize_ <= MAX_BLOCK_BYTES) {
+        nextBlockNodes_ *= 2;
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
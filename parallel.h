@@ -0,0 +1,101 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+* Small fork/join helpers used by the bulk tree operations.
+* Work is split with std::async so that exceptions thrown on a worker
+* thread are rethrown to the caller instead of terminating.
+*/
+
+/**
+* Number of threads to use when the caller passes 0 ("pick for me").
+*/
+inline unsigned defaultThreadCount()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/**
+* Runs f and g and returns once both are done: f on a new thread when
+* fork is true (and a thread can be started), both on the calling
+* thread otherwise.
+*/
+template<typename F, typename G>
+void forkJoin(bool fork, F f, G g)
+{
+    std::future<void> pending;
+    if (fork) {
+        try {
+            pending = std::async(std::launch::async, f);
+        }
+        catch (const std::system_error&) {
+            fork = false;
+        }
+    }
+    if (!fork) f();
+    g();
+    if (fork) pending.get();
+}
+
+/**
+* A stable sort that sorts up to `threads` chunks concurrently and then
+* merges neighbouring runs pairwise, also concurrently. Small inputs are
+* sorted on the calling thread.
+*/
+template<typename RandomIt, typename Compare>
+void parallelStableSort(RandomIt first, RandomIt last, Compare comp, unsigned threads = 0)
+{
+    const std::size_t MIN_CHUNK = 1 << 14;
+    std::size_t n = last - first;
+    if (threads == 0) threads = defaultThreadCount();
+    std::size_t chunks = std::min<std::size_t>(threads, n / MIN_CHUNK);
+    if (chunks <= 1) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+
+    // run boundaries: run i is [bounds[i], bounds[i+1])
+    std::vector<std::size_t> bounds;
+    for (std::size_t i = 0; i <= chunks; i++) {
+        bounds.push_back(n * i / chunks);
+    }
+
+    std::vector<std::future<void> > pending;
+    for (std::size_t i = 1; i < chunks; i++) {
+        pending.push_back(std::async(std::launch::async, [=]() {
+            std::stable_sort(first + bounds[i], first + bounds[i + 1], comp);
+        }));
+    }
+    std::stable_sort(first + bounds[0], first + bounds[1], comp);
+    for (std::size_t i = 0; i < pending.size(); i++) pending[i].get();
+
+    // merge neighbouring runs until one is left
+    while (bounds.size() > 2) {
+        std::vector<std::size_t> merged;
+        pending.clear();
+        for (std::size_t i = 0; i + 2 < bounds.size(); i += 2) {
+            RandomIt lo = first + bounds[i];
+            RandomIt mid = first + bounds[i + 1];
+            RandomIt hi = first + bounds[i + 2];
+            pending.push_back(std::async(std::launch::async, [=]() {
+                std::inplace_merge(lo, mid, hi, comp);
+            }));
+            merged.push_back(bounds[i]);
+        }
+        // an odd run out is carried to the next round as is
+        if (bounds.size() % 2 == 0) merged.push_back(bounds[bounds.size() - 2]);
+        merged.push_back(bounds.back());
+        for (std::size_t i = 0; i < pending.size(); i++) pending[i].get();
+        bounds.swap(merged);
+    }
+}
+
+#endif
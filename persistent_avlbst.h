@@ -0,0 +1,713 @@
+#ifndef PERSISTENT_AVLBST_H
+#define PERSISTENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+/**
+* An AVL tree whose versions share structure. Copying one, or taking a
+* snapshot(), is O(1): both versions point at the same nodes, and every
+* node counts the versions and parents that point at it. insert() and
+* remove() copy the nodes on the path from the root to the change that
+* are shared with another version and update the rest in place, so a
+* tree with no live snapshots is changed in place like an AVLTree and a
+* tree with one pays O(log n) node copies per update.
+*
+* Nodes have no parent links (a shared node has more than one parent),
+* so iterators carry the path from the root instead. An iterator stays
+* valid for as long as its version lives and is not changed; a snapshot
+* that is only read keeps every iterator into it valid.
+*
+* A version must not be used by two threads at once, but different
+* versions may be, even while they share nodes: a writer can keep
+* changing the tree while readers walk snapshots of it. Shared nodes are
+* never changed, and the counts are atomic so that the last version to
+* let go of a node frees it, whichever thread that is on.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+    struct PersistentNode;
+
+public:
+    typedef std::pair<const Key, Value> value_type;
+    class const_iterator;
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    explicit PersistentAVLTree(const Compare& comp = Compare());
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other) noexcept;
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other) noexcept;
+    ~PersistentAVLTree();
+    void swap(PersistentAVLTree& other);
+
+    // An O(1) copy of the current version; later changes to either one
+    // do not show in the other.
+    PersistentAVLTree snapshot() const;
+
+    void insert(const value_type& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    const_iterator find(const Key& key) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator upper_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+
+    /**
+    * A bidirectional iterator over one version. It holds the path from
+    * the root down to its item; end() is the empty path.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator();
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        explicit const_iterator(PersistentNode* root);
+        void push(PersistentNode* node) { path_[depth_++] = node; }
+        void descendLeft(PersistentNode* node);
+        void descendRight(PersistentNode* node);
+
+        // AVL trees of 2^44 nodes are less than 64 deep
+        static const int MAX_DEPTH = 64;
+        PersistentNode* root_;
+        int depth_;
+        PersistentNode* path_[MAX_DEPTH];
+    };
+
+private:
+    struct PersistentNode {
+        explicit PersistentNode(const value_type& keyValuePair);
+        PersistentNode(const PersistentNode& other);
+
+        value_type item;
+        PersistentNode* left;
+        PersistentNode* right;
+        // versions and parents pointing here
+        std::atomic<unsigned> refs;
+        int height;
+    };
+
+    static int heightOf(const PersistentNode* node) { return node == nullptr ? 0 : node->height; }
+    static void updateHeight(PersistentNode* node);
+    static void retain(PersistentNode* node);
+    static void release(PersistentNode* node);
+    static PersistentNode* own(PersistentNode* node);
+
+    PersistentNode* insertAt(PersistentNode* node, const value_type& keyValuePair);
+    PersistentNode* removeAt(PersistentNode* node, const Key& key);
+    static PersistentNode* removeMin(PersistentNode* node, PersistentNode*& min);
+    static PersistentNode* rebalance(PersistentNode* node);
+    static PersistentNode* rotateLeft(PersistentNode* node);
+    static PersistentNode* rotateRight(PersistentNode* node);
+    static int checkBalanced(const PersistentNode* node, bool& balanced);
+
+    PersistentNode* root_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentNode::PersistentNode(const value_type& keyValuePair) :
+    item(keyValuePair), left(nullptr), right(nullptr), refs(1), height(1)
+{
+}
+
+/**
+* Copies the item and the child links; the caller retains the children.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentNode::PersistentNode(const PersistentNode& other) :
+    item(other.item), left(other.left), right(other.right), refs(1), height(other.height)
+{
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr), size_(0), comp_(comp)
+{
+}
+
+/**
+* O(1): the copy shares every node with other.
+*/
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(other.root_), size_(other.size_), comp_(other.comp_)
+{
+    retain(root_);
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree&& other) noexcept :
+    root_(other.root_), size_(other.size_), comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    PersistentAVLTree copy(other);
+    swap(copy);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>&
+PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree&& other) noexcept
+{
+    clear();
+    swap(other);
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::swap(PersistentAVLTree& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+    std::swap(comp_, other.comp_);
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return PersistentAVLTree(*this);
+}
+
+/**
+* Inserts the item, or overwrites the value of an existing key.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const value_type& keyValuePair)
+{
+    root_ = insertAt(root_, keyValuePair);
+}
+
+/**
+* Removes the key if present. A missing key leaves every node alone, so
+* nothing is copied.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    if (find(key) == end()) return;
+    root_ = removeAt(root_, key);
+    size_--;
+}
+
+/**
+* Lets go of this version's nodes; nodes still shared with other
+* versions stay.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    const_iterator it(root_);
+    PersistentNode* node = root_;
+    while (node != nullptr) {
+        it.push(node);
+        if (comp_(key, node->item.first)) node = node->left;
+        else if (comp_(node->item.first, key)) node = node->right;
+        else return it;
+    }
+    return end();
+}
+
+/**
+* The first item whose key is not less than key. The path is walked to
+* the bottom and then cut back to the last node where it turned left.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    const_iterator it(root_);
+    int found = 0;
+    for (PersistentNode* node = root_; node != nullptr; ) {
+        it.push(node);
+        if (comp_(node->item.first, key)) {
+            node = node->right;
+        }
+        else {
+            found = it.depth_;
+            node = node->left;
+        }
+    }
+    it.depth_ = found;
+    return it;
+}
+
+/**
+* The first item whose key is greater than key.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    const_iterator it(root_);
+    int found = 0;
+    for (PersistentNode* node = root_; node != nullptr; ) {
+        it.push(node);
+        if (comp_(key, node->item.first)) {
+            found = it.depth_;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+    it.depth_ = found;
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+Value const & PersistentAVLTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    const_iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    const_iterator it(root_);
+    if (root_ != nullptr) it.descendLeft(root_);
+    return it;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return const_iterator(root_);
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_reverse_iterator
+PersistentAVLTree<Key, Value, Compare>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_reverse_iterator
+PersistentAVLTree<Key, Value, Compare>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+* Checks the stored heights and the AVL balance of every node.
+*/
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    bool balanced = true;
+    checkBalanced(root_, balanced);
+    return balanced;
+}
+
+template<class Key, class Value, class Compare>
+int PersistentAVLTree<Key, Value, Compare>::checkBalanced(const PersistentNode* node, bool& balanced)
+{
+    if (node == nullptr) return 0;
+    int hL = checkBalanced(node->left, balanced);
+    int hR = checkBalanced(node->right, balanced);
+    if (hL - hR > 1 || hR - hL > 1 || node->height != 1 + std::max(hL, hR)) balanced = false;
+    return 1 + std::max(hL, hR);
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::updateHeight(PersistentNode* node)
+{
+    node->height = 1 + std::max(heightOf(node->left), heightOf(node->right));
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::retain(PersistentNode* node)
+{
+    if (node != nullptr) node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+* Drops one reference. A node that loses its last one is freed and lets
+* go of its children in turn; only the left spine is recursed into, so
+* the depth stays within the tree height.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(PersistentNode* node)
+{
+    while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        PersistentNode* right = node->right;
+        release(node->left);
+        delete node;
+        node = right;
+    }
+}
+
+/**
+* Returns a node that only the caller's version reaches, to be changed
+* in place: node itself if nothing else points at it, else a copy that
+* takes over the caller's reference. Copying retains the children, so
+* they count as shared further down.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::own(PersistentNode* node)
+{
+    if (node->refs.load(std::memory_order_acquire) == 1) return node;
+    PersistentNode* copy = new PersistentNode(*node);
+    retain(copy->left);
+    retain(copy->right);
+    release(node);
+    return copy;
+}
+
+/**
+* Inserts into the subtree at node and returns its new root. Every node
+* on the way down is owned first; on the way back up, nodes are
+* rebalanced until a subtree comes back at its old height.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::insertAt(PersistentNode* node, const value_type& keyValuePair)
+{
+    if (node == nullptr) {
+        PersistentNode* leaf = new PersistentNode(keyValuePair);
+        size_++;
+        return leaf;
+    }
+    node = own(node);
+    int height;
+    if (comp_(keyValuePair.first, node->item.first)) {
+        height = heightOf(node->left);
+        node->left = insertAt(node->left, keyValuePair);
+        if (node->left->height == height) return node;
+    }
+    else if (comp_(node->item.first, keyValuePair.first)) {
+        height = heightOf(node->right);
+        node->right = insertAt(node->right, keyValuePair);
+        if (node->right->height == height) return node;
+    }
+    else {
+        node->item.second = keyValuePair.second;
+        return node;
+    }
+    return rebalance(node);
+}
+
+/**
+* Removes key, which must be present, from the subtree at node and
+* returns its new root. A node with two children is replaced by its
+* successor, which is cut out of the right subtree for that.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::removeAt(PersistentNode* node, const Key& key)
+{
+    node = own(node);
+    if (comp_(key, node->item.first)) {
+        int height = node->left->height;
+        node->left = removeAt(node->left, key);
+        return heightOf(node->left) == height ? node : rebalance(node);
+    }
+    if (comp_(node->item.first, key)) {
+        int height = node->right->height;
+        node->right = removeAt(node->right, key);
+        return heightOf(node->right) == height ? node : rebalance(node);
+    }
+
+    PersistentNode* replacement;
+    if (node->left == nullptr || node->right == nullptr) {
+        replacement = node->left != nullptr ? node->left : node->right;
+    }
+    else {
+        node->right = removeMin(node->right, replacement);
+        replacement->left = node->left;
+        replacement->right = node->right;
+        replacement = rebalance(replacement);
+    }
+    // the replacement takes over node's references to its children
+    node->left = node->right = nullptr;
+    release(node);
+    return replacement;
+}
+
+/**
+* Cuts the smallest node out of the subtree at node, owned and with its
+* right child handed back to the subtree, and returns the new root.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::removeMin(PersistentNode* node, PersistentNode*& min)
+{
+    node = own(node);
+    if (node->left == nullptr) {
+        PersistentNode* right = node->right;
+        node->right = nullptr;
+        min = node;
+        return right;
+    }
+    int height = node->left->height;
+    node->left = removeMin(node->left, min);
+    return heightOf(node->left) == height ? node : rebalance(node);
+}
+
+/**
+* Restores the height and balance of an owned node whose subtrees are
+* balanced and differ in height by at most two; returns the new root.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::rebalance(PersistentNode* node)
+{
+    int balance = heightOf(node->left) - heightOf(node->right);
+    if (balance > 1) {
+        if (heightOf(node->left->left) < heightOf(node->left->right)) {
+            node->left = rotateLeft(own(node->left));
+        }
+        return rotateRight(node);
+    }
+    if (balance < -1) {
+        if (heightOf(node->right->right) < heightOf(node->right->left)) {
+            node->right = rotateRight(own(node->right));
+        }
+        return rotateLeft(node);
+    }
+    updateHeight(node);
+    return node;
+}
+
+/**
+* Rotates the right child up; node is owned, the child is owned here.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::rotateLeft(PersistentNode* node)
+{
+    PersistentNode* right = own(node->right);
+    node->right = right->left;
+    right->left = node;
+    updateHeight(node);
+    updateHeight(right);
+    return right;
+}
+
+/**
+* Rotates the left child up; node is owned, the child is owned here.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PersistentNode*
+PersistentAVLTree<Key, Value, Compare>::rotateRight(PersistentNode* node)
+{
+    PersistentNode* left = own(node->left);
+    node->left = left->right;
+    left->right = node;
+    updateHeight(node);
+    updateHeight(left);
+    return left;
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::const_iterator class.
+  ---------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::const_iterator::const_iterator() : root_(nullptr), depth_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+PersistentAVLTree<Key, Value, Compare>::const_iterator::const_iterator(PersistentNode* root) :
+    root_(root), depth_(0)
+{
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator::reference
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return path_[depth_ - 1]->item;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator::pointer
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator->() const
+{
+    return &(path_[depth_ - 1]->item);
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    if (depth_ != rhs.depth_) return false;
+    return depth_ == 0 || path_[depth_ - 1] == rhs.path_[depth_ - 1];
+}
+
+template<class Key, class Value, class Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Pushes node and then its left spine.
+*/
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::const_iterator::descendLeft(PersistentNode* node)
+{
+    for (; node != nullptr; node = node->left) push(node);
+}
+
+template<class Key, class Value, class Compare>
+void PersistentAVLTree<Key, Value, Compare>::const_iterator::descendRight(PersistentNode* node)
+{
+    for (; node != nullptr; node = node->right) push(node);
+}
+
+/**
+* The leftmost node of the right subtree if there is one, else the
+* nearest ancestor reached from its left.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator&
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator++()
+{
+    PersistentNode* node = path_[depth_ - 1];
+    if (node->right != nullptr) {
+        descendLeft(node->right);
+        return *this;
+    }
+    while (--depth_ > 0 && path_[depth_ - 1]->right == node) {
+        node = path_[depth_ - 1];
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++*this;
+    return old;
+}
+
+/**
+* Mirror image of operator++; end() steps back to the largest item.
+*/
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator&
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator--()
+{
+    if (depth_ == 0) {
+        descendRight(root_);
+        return *this;
+    }
+    PersistentNode* node = path_[depth_ - 1];
+    if (node->left != nullptr) {
+        descendRight(node->left);
+        return *this;
+    }
+    while (--depth_ > 0 && path_[depth_ - 1]->left == node) {
+        node = path_[depth_ - 1];
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --*this;
+    return old;
+}
+
+/*
+  -------------------------------------------------------------------
+  End implementations for the PersistentAVLTree::const_iterator class.
+  -------------------------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,559 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <cstdint>
+#include <utility>
+#include "bst.h"
+
+/**
+* A node for a red-black tree. The color is kept in the low tag bit of
+* the parent link, the way AVLNode keeps its balance, so an RBNode is
+* exactly as large as a Node. New nodes are red.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    template<typename... Args>
+    RBNode(RBNode<Key, Value>* parent, Args&&... itemArgs);
+
+    bool isRed() const;
+    void setRed(bool red);
+
+    // Redefined to return RBNodes; see the Node class in bst.h.
+    RBNode<Key, Value>* getParent() const;
+    RBNode<Key, Value>* getLeft() const;
+    RBNode<Key, Value>* getRight() const;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------
+*/
+
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent)
+{
+    setRed(true);
+}
+
+/**
+* Builds the item in place; see the matching Node constructor.
+*/
+template<class Key, class Value>
+template<typename... Args>
+RBNode<Key, Value>::RBNode(RBNode<Key, Value>* parent, Args&&... itemArgs) :
+    Node<Key, Value>(parent, std::forward<Args>(itemArgs)...)
+{
+    setRed(true);
+}
+
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return (this->getTag() & 1) != 0;
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setRed(bool red)
+{
+    this->setTag(red ? 1 : 0);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(Node<Key, Value>::getParent());
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------
+*/
+
+/**
+* A red-black tree: the same interface as AVLTree, for write-heavy use.
+* It is balanced more loosely (height up to 2 log2(n + 1) rather than
+* about 1.44 log2 n), so lookups may take a level or two more, but an
+* insert does at most two rotations and a remove at most three. An AVL
+* remove can rotate at every level on the way up. Recoloring can still
+* climb the tree, but is O(1) amortized per update.
+*/
+template <class Key, class Value, class Compare = std::less<Key> >
+class RBTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    RBTree();
+    explicit RBTree(const Compare& comp);
+    RBTree(const RBTree& other);
+    RBTree(RBTree&& other) noexcept;
+    RBTree& operator=(const RBTree& other);
+    RBTree& operator=(RBTree&& other) noexcept;
+    virtual ~RBTree();
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void insert(std::pair<const Key, Value>&& new_item);
+    // Hinted inserts; see BinarySearchTree.
+    iterator insert(iterator hint, const std::pair<const Key, Value>& new_item);
+    iterator insert(iterator hint, std::pair<const Key, Value>&& new_item);
+    virtual void remove(const Key& key);
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+    // Checks the red-black rules rather than the AVL height rule that
+    // BinarySearchTree::isBalanced checks: the root is black, no red
+    // node has a red child, and every path down has as many black nodes.
+    bool isBalanced() const;
+
+protected:
+    virtual void destroyNode(Node<Key, Value>* node);
+    virtual void removeNode(Node<Key, Value>* n);
+
+    static bool isRed(RBNode<Key, Value>* n);
+    void rotateLeft(RBNode<Key, Value>* x);
+    void rotateRight(RBNode<Key, Value>* x);
+    void insertFix(Node<Key, Value>* n);
+    void removeFix(RBNode<Key, Value>* x, RBNode<Key, Value>* parent);
+    static int blackHeight(RBNode<Key, Value>* n);
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the RBTree class.
+  -------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>::RBTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), alignof(RBNode<Key, Value>))
+{
+}
+
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>::RBTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), alignof(RBNode<Key, Value>), comp)
+{
+}
+
+/**
+* Copy constructor; colors travel with the cloned nodes.
+*/
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>::RBTree(const RBTree& other) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(RBNode<Key, Value>), alignof(RBNode<Key, Value>), other.comp_)
+{
+    this->root_ = this->template cloneTree<RBNode<Key, Value> >(other.root_);
+}
+
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>::RBTree(RBTree&& other) noexcept :
+    BinarySearchTree<Key, Value, Compare>(std::move(other))
+{
+}
+
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>& RBTree<Key, Value, Compare>::operator=(const RBTree& other)
+{
+    if (this != &other) {
+        RBTree<Key, Value, Compare> copy(other);
+        this->swap(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>& RBTree<Key, Value, Compare>::operator=(RBTree&& other) noexcept
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Clears here so that destroyNode still runs the RBNode destructor.
+*/
+template<class Key, class Value, class Compare>
+RBTree<Key, Value, Compare>::~RBTree()
+{
+    this->clear();
+}
+
+/**
+* Inserts or overwrites, then restores the red-black rules.
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertOrAssign<RBNode<Key, Value> >(
+        new_item, typename BinarySearchTree<Key, Value, Compare>::CopyableItem());
+    if (result.second) {
+        insertFix(result.first);
+    }
+}
+
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::insert(std::pair<const Key, Value>&& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertOrAssign<RBNode<Key, Value> >(
+        std::move(new_item), typename BinarySearchTree<Key, Value, Compare>::MovableItem());
+    if (result.second) {
+        insertFix(result.first);
+    }
+}
+
+template<class Key, class Value, class Compare>
+typename RBTree<Key, Value, Compare>::iterator
+RBTree<Key, Value, Compare>::insert(iterator hint, const std::pair<const Key, Value>& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template insertOrAssignNear<RBNode<Key, Value> >(hint, new_item);
+    if (result.second) {
+        insertFix(result.first);
+    }
+    return this->makeIterator(result.first);
+}
+
+template<class Key, class Value, class Compare>
+typename RBTree<Key, Value, Compare>::iterator
+RBTree<Key, Value, Compare>::insert(iterator hint, std::pair<const Key, Value>&& new_item)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template insertOrAssignNear<RBNode<Key, Value> >(hint, std::move(new_item));
+    if (result.second) {
+        insertFix(result.first);
+    }
+    return this->makeIterator(result.first);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename RBTree<Key, Value, Compare>::iterator, bool>
+RBTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template emplaceUnique<RBNode<Key, Value> >(std::forward<Args>(args)...);
+    if (result.second) {
+        insertFix(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename RBTree<Key, Value, Compare>::iterator, bool>
+RBTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<RBNode<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    if (result.second) {
+        insertFix(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename RBTree<Key, Value, Compare>::iterator, bool>
+RBTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<RBNode<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    if (result.second) {
+        insertFix(result.first);
+    }
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+/**
+* Like AVLTree::remove, a node with two children hands its place, and
+* its color, to its predecessor, so the slot that empties held at most
+* one child. Emptying a red slot, or a black one with a red child to
+* repaint, changes no black count; only a black leaf needs removeFix.
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::remove(const Key& key)
+{
+    Node<Key, Value>* node = this->internalFind(key);
+    if (node == nullptr) return;
+    removeNode(node);
+}
+
+/**
+* The body of remove(), also reached from erase().
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::removeNode(Node<Key, Value>* n)
+{
+    RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(n);
+
+    RBNode<Key, Value>* parent;
+    RBNode<Key, Value>* child;
+    bool fix;
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        RBNode<Key, Value>* pred = static_cast<RBNode<Key, Value>*>(this->predecessor(node));
+        child = pred->getLeft();
+        fix = !pred->isRed();
+        pred->setRed(node->isRed());
+        parent = static_cast<RBNode<Key, Value>*>(this->splicePredecessor(node, pred));
+    }
+    else {
+        parent = node->getParent();
+        child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+        if (child != nullptr) {
+            child->setParent(parent);
+        }
+        if (parent == nullptr) {
+            this->root_ = child;
+        }
+        else if (parent->getLeft() == node) {
+            parent->setLeft(child);
+        }
+        else {
+            parent->setRight(child);
+        }
+        fix = !node->isRed();
+    }
+
+    if (node == this->largest_) {
+        this->largest_ = nullptr;
+    }
+    this->destroyNode(node);
+    if (fix) {
+        removeFix(child, parent);
+    }
+}
+
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* node)
+{
+    static_cast<RBNode<Key, Value>*>(node)->~RBNode();
+    this->pool_.deallocate(node);
+}
+
+/**
+* NULL children count as black.
+*/
+template<class Key, class Value, class Compare>
+bool RBTree<Key, Value, Compare>::isRed(RBNode<Key, Value>* n)
+{
+    return n != nullptr && n->isRed();
+}
+
+/**
+* Lifts x's right child into x's place. setParent keeps the colors,
+* which live in the same word.
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::rotateLeft(RBNode<Key, Value>* x)
+{
+    RBNode<Key, Value>* y = x->getRight();
+    RBNode<Key, Value>* parent = x->getParent();
+    x->setRight(y->getLeft());
+    if (y->getLeft() != nullptr) {
+        y->getLeft()->setParent(x);
+    }
+    y->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = y;
+    }
+    else if (parent->getLeft() == x) {
+        parent->setLeft(y);
+    }
+    else {
+        parent->setRight(y);
+    }
+    y->setLeft(x);
+    x->setParent(y);
+}
+
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::rotateRight(RBNode<Key, Value>* x)
+{
+    RBNode<Key, Value>* y = x->getLeft();
+    RBNode<Key, Value>* parent = x->getParent();
+    x->setLeft(y->getRight());
+    if (y->getRight() != nullptr) {
+        y->getRight()->setParent(x);
+    }
+    y->setParent(parent);
+    if (parent == nullptr) {
+        this->root_ = y;
+    }
+    else if (parent->getRight() == x) {
+        parent->setRight(y);
+    }
+    else {
+        parent->setLeft(y);
+    }
+    y->setRight(x);
+    x->setParent(y);
+}
+
+/**
+* Repairs a red node n with a red parent. A red uncle means recoloring
+* and moving the problem two levels up; a black uncle ends it with one
+* or two rotations.
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::insertFix(Node<Key, Value>* added)
+{
+    RBNode<Key, Value>* n = static_cast<RBNode<Key, Value>*>(added);
+    while (true) {
+        RBNode<Key, Value>* p = n->getParent();
+        if (p == nullptr) {
+            n->setRed(false);
+            return;
+        }
+        if (!p->isRed()) return;
+        // a red parent is never the root, so g exists
+        RBNode<Key, Value>* g = p->getParent();
+        bool parentIsLeft = p == g->getLeft();
+        RBNode<Key, Value>* uncle = parentIsLeft ? g->getRight() : g->getLeft();
+        if (isRed(uncle)) {
+            p->setRed(false);
+            uncle->setRed(false);
+            g->setRed(true);
+            n = g;
+            continue;
+        }
+        if (parentIsLeft) {
+            if (n == p->getRight()) {
+                rotateLeft(p);
+                p = n;
+            }
+            rotateRight(g);
+        }
+        else {
+            if (n == p->getLeft()) {
+                rotateRight(p);
+                p = n;
+            }
+            rotateLeft(g);
+        }
+        p->setRed(false);
+        g->setRed(true);
+        return;
+    }
+}
+
+/**
+* The subtree at x (possibly NULL), a child of parent, is one black node
+* short. A red sibling is rotated up first; then either the sibling can
+* turn red and the shortage moves up to parent, or one or two rotations
+* around it fill the gap and end the walk.
+*/
+template<class Key, class Value, class Compare>
+void RBTree<Key, Value, Compare>::removeFix(RBNode<Key, Value>* x, RBNode<Key, Value>* parent)
+{
+    while (parent != nullptr && !isRed(x)) {
+        // x may be NULL, but then its sibling is not: that side has the
+        // black node x's side lost
+        if (x == parent->getLeft()) {
+            RBNode<Key, Value>* w = parent->getRight();
+            if (w->isRed()) {
+                w->setRed(false);
+                parent->setRed(true);
+                rotateLeft(parent);
+                w = parent->getRight();
+            }
+            if (!isRed(w->getLeft()) && !isRed(w->getRight())) {
+                w->setRed(true);
+                x = parent;
+                parent = x->getParent();
+                continue;
+            }
+            if (!isRed(w->getRight())) {
+                w->getLeft()->setRed(false);
+                w->setRed(true);
+                rotateRight(w);
+                w = parent->getRight();
+            }
+            w->setRed(parent->isRed());
+            parent->setRed(false);
+            w->getRight()->setRed(false);
+            rotateLeft(parent);
+        }
+        else {
+            RBNode<Key, Value>* w = parent->getLeft();
+            if (w->isRed()) {
+                w->setRed(false);
+                parent->setRed(true);
+                rotateRight(parent);
+                w = parent->getLeft();
+            }
+            if (!isRed(w->getLeft()) && !isRed(w->getRight())) {
+                w->setRed(true);
+                x = parent;
+                parent = x->getParent();
+                continue;
+            }
+            if (!isRed(w->getLeft())) {
+                w->getRight()->setRed(false);
+                w->setRed(true);
+                rotateLeft(w);
+                w = parent->getLeft();
+            }
+            w->setRed(parent->isRed());
+            parent->setRed(false);
+            w->getLeft()->setRed(false);
+            rotateRight(parent);
+        }
+        return;
+    }
+    if (x != nullptr) {
+        x->setRed(false);
+    }
+}
+
+/**
+* The black height of the subtree at n, or -1 if it breaks a rule.
+* Recursion is fine here: the trees RBTree builds are at most about
+* 2 log2 n deep.
+*/
+template<class Key, class Value, class Compare>
+int RBTree<Key, Value, Compare>::blackHeight(RBNode<Key, Value>* n)
+{
+    if (n == nullptr) return 1;
+    if (n->isRed() && (isRed(n->getLeft()) || isRed(n->getRight()))) return -1;
+    int left = blackHeight(n->getLeft());
+    if (left == -1) return -1;
+    int right = blackHeight(n->getRight());
+    if (right != left) return -1;
+    return left + (n->isRed() ? 0 : 1);
+}
+
+template<class Key, class Value, class Compare>
+bool RBTree<Key, Value, Compare>::isBalanced() const
+{
+    RBNode<Key, Value>* root = static_cast<RBNode<Key, Value>*>(this->root_);
+    return !isRed(root) && blackHeight(root) != -1;
+}
+
+/*
+  -----------------------------------------
+  End implementations for the RBTree class.
+  -----------------------------------------
+*/
+
+#endif
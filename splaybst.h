@@ -0,0 +1,325 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <utility>
+#include "bst.h"
+
+/**
+* Compile-time options for SplayTree. With SemiSplay, a zig-zig step
+* rotates only the parent, halving the accessed path's depth instead of
+* moving the node all the way up; that is about half the rotations, and
+* so half the pointer writes. SplayPeriod k splays on every k-th access
+* only, trading the splay tree's amortized bound for fewer writes. Hot
+* keys still drift to the top, just more slowly.
+*/
+template<bool SemiSplay = false, unsigned SplayPeriod = 1>
+struct SplayOptions
+{
+    static const bool semiSplay = SemiSplay;
+    static const unsigned splayPeriod = SplayPeriod;
+};
+
+/**
+* A splay tree: every access (find, operator[], insert, remove) rotates
+* the node it touched up to the root, so keys used often stay near the
+* top and a skewed workload walks short paths. The cost is amortized
+* O(log n) per access, and lookups write to the tree, so a SplayTree
+* cannot be read from several threads at once.
+*
+* Only the non-const find and operator[] splay; on a const tree they
+* are the plain BinarySearchTree lookups, as are lower_bound,
+* upper_bound, range and find_many. Nodes are plain Nodes, so copies
+* and moves are BinarySearchTree's.
+*/
+template <class Key, class Value, class Compare = std::less<Key>, class Options = SplayOptions<> >
+class SplayTree : public BinarySearchTree<Key, Value, Compare>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    SplayTree();
+    explicit SplayTree(const Compare& comp);
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+    virtual void insert(std::pair<const Key, Value>&& new_item);
+    iterator insert(iterator hint, const std::pair<const Key, Value>& new_item);
+    iterator insert(iterator hint, std::pair<const Key, Value>&& new_item);
+    virtual void remove(const Key& key);
+
+    using BinarySearchTree<Key, Value, Compare>::find;
+    using BinarySearchTree<Key, Value, Compare>::operator[];
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+
+protected:
+    virtual void removeNode(Node<Key, Value>* node);
+    void access(Node<Key, Value>* n);
+    void splay(Node<Key, Value>* x);
+    void rotateUp(Node<Key, Value>* x);
+
+    // accesses since the last splay, with a SplayPeriod above 1
+    unsigned accesses_;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the SplayTree class.
+  ----------------------------------------------
+*/
+
+template<class Key, class Value, class Compare, class Options>
+SplayTree<Key, Value, Compare, Options>::SplayTree() :
+    BinarySearchTree<Key, Value, Compare>(),
+    accesses_(0)
+{
+}
+
+template<class Key, class Value, class Compare, class Options>
+SplayTree<Key, Value, Compare, Options>::SplayTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp),
+    accesses_(0)
+{
+}
+
+/**
+* Inserts or overwrites, then splays the node holding the key.
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::insert(const std::pair<const Key, Value>& new_item)
+{
+    access(this->template insertOrAssign<Node<Key, Value> >(
+        new_item, typename BinarySearchTree<Key, Value, Compare>::CopyableItem()).first);
+}
+
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::insert(std::pair<const Key, Value>&& new_item)
+{
+    access(this->template insertOrAssign<Node<Key, Value> >(
+        std::move(new_item), typename BinarySearchTree<Key, Value, Compare>::MovableItem()).first);
+}
+
+/**
+* Inserts from hint as BinarySearchTree::insert(iterator, ...) does, then
+* splays the node holding the key, like the plain insert.
+*/
+template<class Key, class Value, class Compare, class Options>
+typename SplayTree<Key, Value, Compare, Options>::iterator
+SplayTree<Key, Value, Compare, Options>::insert(iterator hint, const std::pair<const Key, Value>& new_item)
+{
+    Node<Key, Value>* node = this->template insertOrAssignNear<Node<Key, Value> >(hint, new_item).first;
+    access(node);
+    return this->makeIterator(node);
+}
+
+template<class Key, class Value, class Compare, class Options>
+typename SplayTree<Key, Value, Compare, Options>::iterator
+SplayTree<Key, Value, Compare, Options>::insert(iterator hint, std::pair<const Key, Value>&& new_item)
+{
+    Node<Key, Value>* node = this->template insertOrAssignNear<Node<Key, Value> >(hint, std::move(new_item)).first;
+    access(node);
+    return this->makeIterator(node);
+}
+
+/**
+* Removes key as BinarySearchTree::remove does, then splays the removed
+* node's parent, the deepest node the removal touched.
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::remove(const Key& key)
+{
+    Node<Key, Value>* node = this->internalFind(key);
+    if (node == nullptr) return;
+    removeNode(node);
+}
+
+/**
+* The body of remove(), also reached from erase().
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::removeNode(Node<Key, Value>* node)
+{
+    Node<Key, Value>* parent;
+    if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+        parent = this->splicePredecessor(node, this->predecessor(node));
+    }
+    else {
+        parent = node->getParent();
+        Node<Key, Value>* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+        if (child != nullptr) {
+            child->setParent(parent);
+        }
+        if (parent == nullptr) {
+            this->root_ = child;
+        }
+        else if (parent->getLeft() == node) {
+            parent->setLeft(child);
+        }
+        else {
+            parent->setRight(child);
+        }
+    }
+    if (node == this->largest_) {
+        this->largest_ = nullptr;
+    }
+    this->destroyNode(node);
+    if (parent != nullptr) {
+        access(parent);
+    }
+}
+
+/**
+* Looks up key and splays the node found (or, on a miss, the last node
+* the search passed, so repeated misses near it get cheaper as well).
+*/
+template<class Key, class Value, class Compare, class Options>
+typename SplayTree<Key, Value, Compare, Options>::iterator
+SplayTree<Key, Value, Compare, Options>::find(const Key& key)
+{
+    Node<Key, Value>* parent;
+    bool asLeft;
+    Node<Key, Value>* node = this->findSlot(key, parent, asLeft);
+    if (parent != nullptr) {
+        access(parent);
+    }
+    return this->makeIterator(node);
+}
+
+/**
+* Like BinarySearchTree::operator[], but the node found is splayed.
+*/
+template<class Key, class Value, class Compare, class Options>
+Value& SplayTree<Key, Value, Compare, Options>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if (it == this->end()) {
+        throw std::out_of_range("Invalid key");
+    }
+    return it->second;
+}
+
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename SplayTree<Key, Value, Compare, Options>::iterator, bool>
+SplayTree<Key, Value, Compare, Options>::emplace(Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result =
+        this->template emplaceUnique<Node<Key, Value> >(std::forward<Args>(args)...);
+    access(result.first);
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename SplayTree<Key, Value, Compare, Options>::iterator, bool>
+SplayTree<Key, Value, Compare, Options>::try_emplace(const Key& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<Node<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    access(result.first);
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+template<class Key, class Value, class Compare, class Options>
+template<typename... Args>
+std::pair<typename SplayTree<Key, Value, Compare, Options>::iterator, bool>
+SplayTree<Key, Value, Compare, Options>::try_emplace(Key&& key, Args&&... args)
+{
+    std::pair<Node<Key, Value>*, bool> result = this->template insertUnique<Node<Key, Value> >(key,
+        std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    access(result.first);
+    return std::make_pair(this->makeIterator(result.first), result.second);
+}
+
+/**
+* Splays n, or with a SplayPeriod k only on every k-th call.
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::access(Node<Key, Value>* n)
+{
+    if (Options::splayPeriod > 1) {
+        if (++accesses_ < Options::splayPeriod) return;
+        accesses_ = 0;
+    }
+    splay(n);
+}
+
+/**
+* Bottom-up splaying. A zig-zig (x and its parent on the same side)
+* rotates the parent first, then x; a zig-zag rotates x twice; a zig,
+* with the parent at the root, rotates x once. When semi-splaying, a
+* zig-zig stops after rotating the parent and carries on from there.
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::splay(Node<Key, Value>* x)
+{
+    while (true) {
+        Node<Key, Value>* p = x->getParent();
+        if (p == nullptr) return;
+        Node<Key, Value>* g = p->getParent();
+        if (g == nullptr) {
+            rotateUp(x);
+            return;
+        }
+        if ((g->getLeft() == p) == (p->getLeft() == x)) {
+            rotateUp(p);
+            if (Options::semiSplay) {
+                x = p;
+                continue;
+            }
+            rotateUp(x);
+        }
+        else {
+            rotateUp(x);
+            rotateUp(x);
+        }
+    }
+}
+
+/**
+* Rotates x above its parent, on whichever side it hangs.
+*/
+template<class Key, class Value, class Compare, class Options>
+void SplayTree<Key, Value, Compare, Options>::rotateUp(Node<Key, Value>* x)
+{
+    Node<Key, Value>* p = x->getParent();
+    Node<Key, Value>* g = p->getParent();
+    if (p->getLeft() == x) {
+        p->setLeft(x->getRight());
+        if (x->getRight() != nullptr) {
+            x->getRight()->setParent(p);
+        }
+        x->setRight(p);
+    }
+    else {
+        p->setRight(x->getLeft());
+        if (x->getLeft() != nullptr) {
+            x->getLeft()->setParent(p);
+        }
+        x->setLeft(p);
+    }
+    p->setParent(x);
+    x->setParent(g);
+    if (g == nullptr) {
+        this->root_ = x;
+    }
+    else if (g->getLeft() == p) {
+        g->setLeft(x);
+    }
+    else {
+        g->setRight(x);
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the SplayTree class.
+  --------------------------------------------
+*/
+
+#endif